@@ -0,0 +1,268 @@
+//benchmark of the editing primitives
+//usage: bench/editing [name [lines [length [rows]]]]
+//  (without a name, every workload runs with a few sets of parameters)
+//  (rows: rows of a region to be deleted or copied, or of a kill to be pasted)
+//each workload runs in a child process of its own, so that the peak RSS is of that workload alone
+//output: a line for each workload, of "key=value"s after its name
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+//every allocation made by the editor is counted
+size_t allocations = 0;
+
+void* countMalloc(size_t size){
+  ++allocations;
+  return malloc(size);
+}
+
+void* countCalloc(size_t count, size_t size){
+  ++allocations;
+  return calloc(count, size);
+}
+
+void* countRealloc(void* pointer, size_t size){
+  ++allocations;
+  return realloc(pointer, size);
+}
+
+#define malloc(size) countMalloc(size)
+#define calloc(count, size) countCalloc((count), (size))
+#define realloc(pointer, size) countRealloc((pointer), (size))
+#define EDITOR_NO_MAIN
+#include "../editor.c"
+
+struct _Bench;
+
+typedef struct _Workload{
+  char* name;
+  void (*load)(int lines, int length, Editor* editor); //(how the lines get into the buffer)
+  void (*prepare)(struct _Bench* bench); //(not measured, NULL: nothing to prepare)
+  void (*operate)(struct _Bench* bench);
+  int lines;
+  int length;
+  int rows;
+  int operations;
+} Workload;
+
+typedef struct _Bench{
+  Workload* workload;
+  Editor* editor;
+  int operation; //(the one in progress)
+} Bench;
+
+double now(){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+//a row scattered over the buffer for the operation in progress
+int scatter(int range, Bench* bench){
+  return (int)(((unsigned long)bench->operation * 7919) % range); //ad-hoc (a prime)
+}
+
+//"lines" lines of "length" bytes each, inserted at once
+void fill(int lines, int length, Editor* editor){
+  size_t size = (size_t)lines * (length + 1);
+  char* text = malloc(size);
+  for(size_t i = 0; i < size; i++)
+    text[i] = (i % (length + 1) == (size_t)length) ? '\n' : "int x = 0; // abc"[i % 17];
+  insertText(text, size - 1, editor);
+  free(text);
+  editor->cursor.row = 0;
+  editor->cursor.column = 0;
+}
+
+//the same lines, written to a file and opened, so that the rows are mapped
+void map(int lines, int length, Editor* editor){
+  char path[] = "/tmp/benchXXXXXX";
+  int fd = mkstemp(path);
+  if(fd == -1){
+    perror("mkstemp()");
+    exit(1);
+  }
+  size_t size = (size_t)lines * (length + 1);
+  char* text = malloc(size);
+  for(size_t i = 0; i < size; i++)
+    text[i] = (i % (length + 1) == (size_t)length) ? '\n' : "int x = 0; // abc"[i % 17];
+  bool isWritten = (write(fd, text, size - 1) == (ssize_t)(size - 1));
+  free(text);
+  close(fd);
+  if(!isWritten || !openFile(path, editor)){
+    fprintf(stderr, "%s: could not be opened\n", path);
+    unlink(path);
+    exit(1);
+  }
+  unlink(path); //(the mapping stays valid)
+}
+
+void prepareKill(Bench* bench){
+  Editor* editor = bench->editor;
+  mark(&(editor->buffer.region), 0, 0);
+  point(&(editor->buffer.region), bench->workload->rows, 0);
+  copyRegion(editor);
+  deactivateRegion(editor);
+}
+
+void prepareSyntax(Bench* bench){
+  bench->editor->buffer.syntax = chooseSyntax("bench.c");
+}
+
+void operateAdd(Bench* bench){
+  Buffer* buffer = &(bench->editor->buffer);
+  Row* row = getRow(scatter(buffer->size, bench), buffer);
+  add('x', row, row->size / 2);
+}
+
+void operateInject(Bench* bench){
+  Buffer* buffer = &(bench->editor->buffer);
+  inject(createEmptyRow(bench->workload->length, &(buffer->arena)), buffer, scatter(buffer->size, bench));
+}
+
+void operateDeleteRegion(Bench* bench){
+  Editor* editor = bench->editor;
+  int r = scatter(editor->buffer.size - bench->workload->rows, bench);
+  mark(&(editor->buffer.region), r, 1);
+  point(&(editor->buffer.region), r + bench->workload->rows, 1);
+  deleteRegion(editor);
+  deactivateRegion(editor);
+}
+
+void operateCopyRegion(Bench* bench){
+  Editor* editor = bench->editor;
+  int r = scatter(editor->buffer.size - bench->workload->rows, bench);
+  mark(&(editor->buffer.region), r, 1);
+  point(&(editor->buffer.region), r + bench->workload->rows, 1);
+  copyRegion(editor);
+  deactivateRegion(editor);
+}
+
+void operatePaste(Bench* bench){
+  Editor* editor = bench->editor;
+  editor->cursor.row = scatter(editor->buffer.size, bench);
+  editor->cursor.column = 0;
+  pasteFromClipboard(editor);
+}
+
+//a page down and a draw of every line of it, back to the top at the bottom
+void operateDraw(Bench* bench){
+  Editor* editor = bench->editor;
+  if(editor->buffer.size - editor->window.rows <= editor->cursor.row){
+    editor->cursor.row = 0;
+    editor->cursor.column = 0;
+    scroll(editor);
+  }else{
+    moveCursorDownward(editor);
+  }
+  draw(editor);
+}
+
+void run(Workload* workload){
+  Editor* editor = createSizedEditor(50, 200); //ad-hoc
+  editor->window.output = -1;
+  workload->load(workload->lines, workload->length, editor);
+  Bench bench = {workload, editor, 0};
+  if(workload->prepare != NULL)
+    workload->prepare(&bench);
+
+  allocations = 0;
+  double began = now();
+  for(int i = 0; i < workload->operations; i++){
+    bench.operation = i;
+    workload->operate(&bench);
+  }
+  double seconds = now() - began;
+  size_t counted = allocations;
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  long peak = usage.ru_maxrss / 1024; //(bytes on macOS)
+#else
+  long peak = usage.ru_maxrss; //(KiB on Linux)
+#endif
+  printf("%-13s lines=%d length=%d rows=%d ops=%d ns/op=%.1f allocs/op=%.3f peak_rss_kb=%ld\n",
+    workload->name, workload->lines, workload->length, workload->rows, workload->operations,
+    seconds * 1e9 / workload->operations, (double)counted / workload->operations, peak);
+  dispose(editor);
+}
+
+bool runApart(Workload* workload){
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == -1){
+    perror("fork()");
+    return false;
+  }
+  if(pid == 0){
+    run(workload);
+    fflush(stdout);
+    _exit(0);
+  }
+  int status;
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+//(each operation is on a row far from the last one, so that the gap of the buffer moves a lot)
+//(deleteRegion: up to the half of the lines are deleted)
+Workload workloads[] = {
+  {"add", fill, NULL, operateAdd, 100000, 8, 0, 1000000},
+  {"add", fill, NULL, operateAdd, 100000, 80, 0, 1000000},
+  {"add", fill, NULL, operateAdd, 10000, 4000, 0, 1000000},
+  {"inject", fill, NULL, operateInject, 10000, 80, 0, 1000},
+  {"inject", fill, NULL, operateInject, 1000000, 80, 0, 1000},
+  {"deleteRegion", fill, NULL, operateDeleteRegion, 1000000, 80, 1, 1000},
+  {"deleteRegion", fill, NULL, operateDeleteRegion, 1000000, 80, 100, 1000},
+  {"deleteRegion", fill, NULL, operateDeleteRegion, 1000000, 80, 10000, 49},
+  {"copyRegion", fill, NULL, operateCopyRegion, 1000000, 80, 1, 10000},
+  {"copyRegion", fill, NULL, operateCopyRegion, 1000000, 80, 100, 10000},
+  {"copyRegion", fill, NULL, operateCopyRegion, 1000000, 80, 10000, 100},
+  {"paste", fill, prepareKill, operatePaste, 100000, 80, 1, 1000},
+  {"paste", fill, prepareKill, operatePaste, 100000, 80, 100, 1000},
+  {"paste", fill, prepareKill, operatePaste, 100000, 80, 10000, 100},
+  {"draw", fill, NULL, operateDraw, 1000000, 80, 0, 1000},
+  {"draw", fill, NULL, operateDraw, 1000000, 8, 0, 1000},
+  {"scroll", fill, NULL, operateDraw, 1000000, 40, 0, 20000}, //(through the whole buffer, of lines short enough to be inline)
+  {"scroll(map)", map, NULL, operateDraw, 1000000, 40, 0, 20000}, //(the same lines, mapped from a file)
+  {"draw(c)", fill, prepareSyntax, operateDraw, 1000000, 80, 0, 1000}
+};
+
+int main(int argc, char** argv){
+  int n = sizeof(workloads) / sizeof(Workload);
+  bool isOK = true;
+  if(1 < argc){
+    Workload* chosen = NULL;
+    for(int i = 0; i < n && chosen == NULL; i++){
+      if(strcmp(workloads[i].name, argv[1]) == 0)
+        chosen = &(workloads[i]);
+    }
+    if(chosen == NULL){
+      fprintf(stderr, "usage: %s [name [lines [length [rows]]]]\n", argv[0]);
+      return 1;
+    }
+    Workload workload = *chosen;
+    if(2 < argc)
+      workload.lines = atoi(argv[2]);
+    if(3 < argc)
+      workload.length = atoi(argv[3]);
+    if(4 < argc)
+      workload.rows = atoi(argv[4]);
+    if(workload.lines < 1 || workload.length < 1 || workload.rows < 0 || workload.lines <= workload.rows + 1){
+      fprintf(stderr, "%s: lines > rows + 1, length > 0 and rows >= 0 required\n", argv[0]);
+      return 1;
+    }
+    if(workload.operate == operateDeleteRegion && workload.lines / (workload.rows + 1) / 2 < workload.operations)
+      workload.operations = workload.lines / (workload.rows + 1) / 2;
+    if(workload.operations < 1){
+      fprintf(stderr, "%s: too few lines for the rows\n", argv[0]);
+      return 1;
+    }
+    isOK = runApart(&workload);
+  }else{
+    for(int i = 0; i < n; i++)
+      isOK = runApart(&(workloads[i])) && isOK;
+  }
+  return isOK ? 0 : 1;
+}
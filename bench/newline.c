@@ -0,0 +1,117 @@
+//benchmark of the newline indexers
+//usage: bench/newline [file]
+//  (without a file, a synthetic text of 256 MiB is generated)
+#define EDITOR_NO_MAIN
+#include "../editor.c"
+
+#include <time.h>
+
+double now(){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+//the plain byte loop for comparison
+size_t* indexByLoop(char* text, size_t length, size_t* lines){
+  size_t n = 1;
+  for(size_t i = 0; i < length; i++){
+    if(text[i] == '\n')
+      ++n;
+  }
+  size_t* offsets = malloc(sizeof(size_t) * (n + 1));
+  size_t l = 0;
+  offsets[l++] = 0;
+  for(size_t i = 0; i < length; i++){
+    if(text[i] == '\n')
+      offsets[l++] = i + 1;
+  }
+  offsets[n] = length + 1;
+  *lines = n;
+  return offsets;
+}
+
+char* generate(size_t length){
+  char* text = malloc(length);
+  uint32_t seed = 2463534242u;
+  size_t i = 0;
+  while(i < length){
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    size_t line = seed % 120; //ad-hoc, 60 bytes per line on average
+    for(size_t k = 0; k < line && i < length; k++, i++)
+      text[i] = 'a' + (i % 26);
+    if(i < length)
+      text[i++] = '\n';
+  }
+  return text;
+}
+
+void report(char* name, int threads, double seconds, size_t length, size_t lines){
+  printf("%-8s threads=%-3d %8.3f ms %7.2f GB/s (%zu lines)\n", name, threads, seconds * 1e3, length / seconds / 1e9, lines);
+}
+
+int main(int argc, char** argv){
+  const int repeat = 5;
+  size_t length;
+  char* text;
+  if(1 < argc){
+    int fd = open(argv[1], O_RDONLY);
+    struct stat status;
+    if(fd == -1 || fstat(fd, &status) == -1 || status.st_size == 0){
+      perror(argv[1]);
+      return 1;
+    }
+    length = status.st_size;
+    text = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(text == MAP_FAILED){
+      perror("mmap()");
+      return 1;
+    }
+  }else{
+    length = (size_t)256 * 1024 * 1024;
+    text = generate(length);
+  }
+
+  size_t expected;
+  double best = 1e9;
+  for(int r = 0; r < repeat; r++){
+    double begin = now();
+    free(indexByLoop(text, length, &expected));
+    double elapsed = now() - begin;
+    if(elapsed < best)
+      best = elapsed;
+  }
+  report("loop", 1, best, length, expected);
+
+  int processors = countProcessors();
+  int n = sizeof(indexers) / sizeof(Indexer);
+  for(int i = 0; i < n; i++){
+    Indexer* indexer = &(indexers[i]);
+    if(!indexer->isSupported())
+      continue;
+    for(int threads = 1; threads <= processors; threads *= 2){
+      size_t lines;
+      best = 1e9;
+      for(int r = 0; r < repeat; r++){
+        double begin = now();
+        size_t* offsets = indexLines(indexer, text, length, &lines, threads);
+        double elapsed = now() - begin;
+        free(offsets);
+        if(elapsed < best)
+          best = elapsed;
+      }
+      if(lines != expected){
+        fprintf(stderr, "%s: %zu lines (expected %zu)\n", indexer->name, lines, expected);
+        return 1;
+      }
+      report(indexer->name, threads, best, length, lines);
+      if(threads < processors && processors < threads * 2)
+        threads = processors / 2;
+    }
+  }
+  printf("(chosen at runtime: %s)\n", chooseIndexer()->name);
+  return 0;
+}
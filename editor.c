@@ -1,15 +1,33 @@
+#ifndef _DEFAULT_SOURCE //(defined already when included by a benchmark)
+#define _DEFAULT_SOURCE
+#endif
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 typedef enum _Key{
   DELETE_LEFT = 127, //ASCII table value for DEL
-  DELETE_RIGHT,
+  DELETE_RIGHT = 256, //(after the bytes, which come one by one in UTF-8 sequences)
   DELETE_RIGHT_HALF,
   NEWLINE,
   UP,
@@ -26,6 +44,20 @@ typedef enum _Key{
   CUT_REGION,
   PASTE,
   CANCEL_COMMAND,
+  SAVE,
+  PASTE_TEXT, //text of a bracketed paste (Input.paste)
+  YANK_POP,
+  UNDO,
+  REDO,
+  SEARCH_FORWARD,
+  SEARCH_BACKWARD,
+  FIND_ALL,
+  NEXT_HIT,
+  PREVIOUS_HIT,
+  REPLACE_ALL,
+  GOTO_LINE,
+  GOTO_BYTE,
+  SHOW_LATENCY,
   QUIT
 } Key;
 
@@ -42,29 +74,313 @@ typedef struct _Region{
   Point* tail;
 } Region;
 
+//characters of a row, shared with the clips taken from it (freed when no one refers to it)
+typedef struct _Block{
+  int references;
+  char raw[];
+} Block;
+
+//a character of a row which is not a single byte of a single column, where display columns and bytes stop going one to one
+//(a tab is one, as wide as to the next tab stop)
+typedef struct _Break{
+  int at;
+  int column;
+  unsigned char length; //bytes
+  unsigned char width; //display columns
+} Break;
+
+enum{ROW_SMALL = 48}; //ad-hoc (bytes of a row kept in the row itself)
+
 typedef struct _Row{
   int capacity;
   int size;
+  int gap; //raw[gap] to raw[gap + (capacity - size) - 1] are unused bytes
+  int width; //display columns of the row
   char* raw;
+  Block* block; //where raw is (NULL while mapped or small)
+  unsigned long stamp; //renewed whenever the characters change
+  unsigned long measured; //stamp of the characters when the breaks were taken (0: not yet), as the tab width is fixed
+  int breakCount; //(0: every byte is a column, as in ASCII without tabs)
+  int breakCapacity;
+  Break* breaks;
   bool isEnabled;
+  bool isMapped; //raw points into Source.map until the row is first edited
+  bool hasSmall; //the row is followed by ROW_SMALL bytes, where raw is until it grows out of them
+  char small[]; //(only if hasSmall)
 } Row;
 
+enum{ARENA_SLAB = 1024 * 1024, ARENA_CLASSES = 15, ARENA_SMALLEST = 16}; //ad-hoc (slab: bytes, classes: pieces of 16, 24, 32, 48, ... 2048 bytes)
+
+struct _Arena;
+
+//memory cut into headers of rows and into pieces
+//(aligned to its size, so that what is cut from it finds its arena by the address)
+typedef struct _Slab{
+  struct _Slab* next;
+  struct _Arena* arena;
+  char raw[];
+} Slab;
+
+//a piece larger than the classes, allocated by itself (followed by the class, and then the piece)
+typedef struct _Large{
+  struct _Large* previous;
+  struct _Large* next;
+  struct _Arena* arena;
+} Large;
+
+//where the rows of a buffer, their blocks and breaks come from, freed all at once rather than row by row
+//(blocks outlive their rows in the kill ring, and the arena is locked, as the workers of replaceAll() make rows)
+//(a piece is preceded by its class, and a free one or a free row begins with the next free one)
+typedef struct _Arena{
+  pthread_mutex_t lock;
+  Slab* slabs;
+  char* rest; //not cut yet in the latest slab
+  size_t restSize;
+  void* freeRows;
+  void* freeSmallRows; //(followed by ROW_SMALL bytes)
+  void* freePieces[ARENA_CLASSES];
+  Large* large;
+} Arena;
+
+typedef struct _Source{
+  char* path;
+  char* map;
+  size_t length;
+  int lines;
+  size_t* offsets; //offsets[i]: where the i-th line begins (offsets[lines] == length + 1)
+} Source;
+
+//read-only look at the characters of a row (before and after its gap)
+typedef struct _View{
+  char* front;
+  int frontSize;
+  char* back;
+  int backSize;
+} View;
+
+//finds newlines in a text: count() counts them and fill() stores where each following line begins (base + offset + 1)
+typedef struct _Indexer{
+  char* name;
+  bool (*isSupported)();
+  size_t (*count)(const char* text, size_t length);
+  size_t* (*fill)(const char* text, size_t length, size_t base, size_t* offsets);
+} Indexer;
+
+//finds whether a text is plain: all ASCII and no tab, in which every byte is a column
+typedef struct _Checker{
+  char* name;
+  bool (*isSupported)();
+  bool (*isPlain)(const char* text, int length);
+} Checker;
+
+//finds a needle in a text: find() returns where it begins first (-1: nowhere)
+typedef struct _Finder{
+  char* name;
+  bool (*isSupported)();
+  int (*find)(const char* text, int length, const char* needle, int size);
+} Finder;
+
+//what a character is a part of, to be colored by
+typedef enum _Token{
+  PLAIN,
+  KEYWORD,
+  TYPE,
+  NUMBER,
+  STRING, //(and a character literal)
+  COMMENT,
+  DIRECTIVE
+} Token;
+
+//a language to be highlighted: lex() goes through a row from the lexer state at the end of the previous row (0 at the beginning of the text),
+//puts a Token for each character into "tokens" (NULL: only the state is needed), and returns the state at the end of the row
+typedef struct _Syntax{
+  char* name;
+  char* extensions; //(each of them between spaces)
+  unsigned char (*lex)(View* view, unsigned char state, char* tokens);
+} Syntax;
+
+typedef enum _NodeType{
+  EMPTY,
+  SPLIT,
+  SET,
+  BEGIN, //(^)
+  END, //($)
+  MATCH
+} NodeType;
+
+//a node of the NFA of a regular expression (EMPTY, SPLIT, BEGIN and END go on without consuming a byte)
+typedef struct _Node{
+  NodeType type;
+  int out;
+  int out1; //(SPLIT)
+  int set; //bytes to be consumed (SET)
+} Node;
+
+//piece of the NFA from "begin" to "end" (an EMPTY node to be connected to what follows)
+typedef struct _Fragment{
+  int begin;
+  int end;
+} Fragment;
+
+typedef struct _Compiler{
+  const char* pattern;
+  int at;
+  int count;
+  int capacity;
+  Node* nodes;
+  int sets;
+  unsigned char (*bits)[32]; //bits[set][byte / 8] & (1 << (byte % 8)): whether a set has a byte
+  char* error;
+} Compiler;
+
+//DFA made from the NFA
+typedef struct _Automaton{
+  int states; //(state 0 is the dead one)
+  int* next; //next[state * 256 + byte]
+  bool* isAccepting;
+  bool* isAcceptingAtEnd; //(at the end of a row, where $ matches)
+  int startAtBeginning; //start state at the beginning of a row (where ^ matches)
+  int start;
+} Automaton;
+
+//states of an automaton under construction, each of which is a sorted set of NFA nodes
+typedef struct _Subsets{
+  int count;
+  int capacity;
+  int* begins; //the "i"-th set is pool[begins[i]] to pool[begins[i + 1] - 1]
+  int poolSize;
+  int poolCapacity;
+  int* pool;
+  int* table; //hash table of the sets (-1: empty)
+  int mask;
+} Subsets;
+
+enum{MAX_STATES = 4096}; //ad-hoc
+
+typedef struct _Regex{
+  Automaton anchored; //matches from a given column
+  Automaton unanchored; //tells whether a row has a match anywhere
+} Regex;
+
+typedef struct _Section{
+  Indexer* indexer;
+  const char* text;
+  size_t begin;
+  size_t end;
+  size_t count;
+  size_t* offsets;
+} Section;
+
 typedef struct _Buffer{
   int capacity;
   int size;
-  Row** rows;
+  int gap; //rows[gap] to rows[gap + (capacity - size) - 1] are unused slots
+  Row** rows; //a slot holds a line number of the source (tagged by the lowest bit) until the row is first needed
+  size_t* lengths; //Fenwick tree (lengths[1] to lengths[capacity]) of the lengths of the slots: a row and its newline, 0 for an unused slot
   Region region;
+  Source source;
+  Syntax* syntax; //(NULL: no highlighting)
+  unsigned char* states; //lexer state at the end of each row, by row number (one for each slot, rather than in the rows)
+  int lexed; //rows[0] to rows[lexed - 1] have their lexer states settled
+  Arena arena; //where the rows come from
 } Buffer;
 
+//a line of a kill, looking into the characters of the row it was taken from
 typedef struct _Clip{
-  Row* row;
+  Block* block; //(NULL: the view is into Source.map)
+  View view;
   struct _Clip* next;
 } Clip;
 
-typedef struct _Clipboard{
+typedef struct _Kill{
   Clip* head;
+  size_t size; //bytes of the text (newlines included)
+} Kill;
+
+enum{KILL_RING_CAPACITY = 60, KILL_RING_LIMIT = 64 * 1024 * 1024}; //ad-hoc (limit: default bytes of the ring)
+
+//ring of recent kills; the oldest ones are dropped when there are too many or they take more than "limit" bytes
+typedef struct _Clipboard{
+  Kill kills[KILL_RING_CAPACITY];
+  int count;
+  int latest; //kills[latest] is the most recent kill
+  size_t size;
+  size_t limit;
+  int yank; //kills[yank] was pasted by the last command from yankFrom to yankTo (-1: the last command was not a paste)
+  Point yankFrom;
+  Point yankTo;
 } Clipboard;
 
+//memory where the texts of records are kept one after another
+typedef struct _Chunk{
+  int references; //records whose text is in the chunk
+  size_t capacity;
+  size_t size;
+  char raw[];
+} Chunk;
+
+typedef enum _Change{
+  INSERTION,
+  DELETION
+} Change;
+
+//an edit of the buffer, undone by the opposite change
+typedef struct _Record{
+  Change change;
+  Point from;
+  Point to;
+  Chunk* chunk; //where the text is (NULL: the inserted text is still in the buffer, taken when it is undone)
+  size_t offset;
+  size_t length;
+  bool isTyping; //a single character, which may be merged with the following ones
+  bool isChained; //undone and redone together with the previous record
+} Record;
+
+enum{CHUNK_CAPACITY = 64 * 1024, HISTORY_LIMIT = 64 * 1024 * 1024}; //ad-hoc (limit: default bytes of the texts)
+
+//records of edits; the oldest ones are dropped when their texts take more than "limit" bytes
+typedef struct _History{
+  int capacity;
+  int first; //records[first] to records[count - 1] are kept
+  int done; //records[done] to records[count - 1] have been undone (to be redone)
+  int latest; //where the most recent edit done begins (an edit is a record and the ones chained to it)
+  int count;
+  Record* records;
+  Chunk* chunk; //where the next text goes
+  size_t size; //bytes of the records and their texts
+  size_t limit;
+} History;
+
+enum{JOURNAL_INTERVAL = 200, JOURNAL_CHUNK = 64 * 1024}; //ad-hoc (interval: default ms between writes of the journal, chunk: bytes to be written at once)
+
+//an edit to be written to the journal, or a save of the file from which the journal begins again
+typedef struct _Entry{
+  struct _Entry* next;
+  bool isSave;
+  Change change;
+  Point from;
+  Point to; //(of a deletion)
+  long long size; //(of the saved file)
+  long long modified;
+  size_t length; //(of the text of an insertion)
+  char text[];
+} Entry;
+
+//edits written by a worker to a file beside the buffer's file, to be replayed on the next launch after a crash
+//the entries go from the main thread to the worker through a queue of a single producer and a single consumer without a lock
+typedef struct _Journal{
+  bool isEnabled;
+  char* path; //of the journal
+  int interval; //ms between writes (each of which is followed by fsync)
+  Entry* head; //(the worker's) the last entry taken, whose next is the first one to be written
+  Entry* tail; //(the main thread's) the last entry put
+  bool isStopping;
+  int wake[2]; //pipe to wake the worker up to stop
+  pthread_t worker;
+  long long size; //of the file which the journal is on (-1: no such file yet)
+  long long modified; //(mtime in seconds)
+} Journal;
+
 typedef struct _Cursor{
   int row;
   int column;
@@ -77,7 +393,6 @@ typedef struct _Scroll{
 
 typedef struct _LineNumberPane{
   int offset;
-  char format[4];
 } LineNumberPane;
 
 typedef struct _StatusPane{
@@ -87,15 +402,164 @@ typedef struct _StatusPane{
   char* message;
 } StatusPane;
 
+//what decides how a row looks on a line of the screen
+typedef struct _Appearance{
+  Row* row;
+  unsigned long stamp;
+  int number;
+  bool isEnabled;
+  bool isCurrent;
+  int from; //region on the row, from "from" (-1: from the beginning) to "to" (INT_MAX: to the end), or both -2
+  int to;
+  int scroll;
+  int offset;
+  unsigned char state; //lexer state at the beginning of the row
+} Appearance;
+
+//append-only bytes which grow as needed
+typedef struct _Builder{
+  int capacity;
+  int size;
+  char* raw;
+} Builder;
+
+struct _Editor;
+
+//a question on the status pane, answered by Enter
+typedef struct _Prompt{
+  bool isActive;
+  char* label;
+  Builder text;
+  void (*answer)(struct _Editor* editor);
+} Prompt;
+
+typedef struct _Hits{
+  int count;
+  int capacity;
+  Point* raw;
+} Hits;
+
+//search of a regular expression over the whole buffer by workers, each of which takes batches of rows in turn
+//(the buffer must not be edited while it is running)
+typedef struct _Scan{
+  bool isRunning;
+  Regex regex;
+  Builder pattern;
+  int batches;
+  int nextBatch; //(shared by the workers)
+  int scannedRows; //(shared by the workers)
+  int found; //(shared by the workers)
+  int empty; //how many of the found are empty matches (shared by the workers)
+  int finished; //(shared by the workers)
+  bool isCancelled; //(shared by the workers)
+  int workers;
+  pthread_t* threads;
+  Hits* results; //results[batch]
+  Hits hits; //all the hits sorted by row and column
+  Buffer* buffer;
+} Scan;
+
+//a row rebuilt by a replace-all, to be swapped in for the "at"-th row
+typedef struct _Rebuilt{
+  int at;
+  int count; //replacements in the row
+  Row* row;
+} Rebuilt;
+
+typedef struct _Rebuilds{
+  int count;
+  int capacity;
+  Rebuilt* raw;
+} Rebuilds;
+
+//replacement of a string over the whole buffer by workers, each of which takes batches of rows in turn (as Scan does)
+//(rows without the string are left alone)
+typedef struct _Replace{
+  Builder from;
+  Builder to;
+  Builder label; //of the prompt for "to"
+  Finder* finder;
+  int batches;
+  int nextBatch; //(shared by the workers)
+  Rebuilds* results; //results[batch]
+  Buffer* buffer;
+} Replace;
+
+//incremental search
+typedef struct _Search{
+  bool isActive;
+  bool isBackward;
+  bool isFound;
+  Builder query;
+  Builder last; //query of the previous search (to be searched again by Ctrl-s or Ctrl-r with an empty query)
+  Point origin; //where the cursor was when the search began
+  Point match; //where the current match begins
+} Search;
+
+//what was drawn last time on a line of the screen
+typedef struct _Line{
+  bool isValid;
+  Appearance appearance;
+  Builder text;
+} Line;
+
+enum{TAB_WIDTH = 8}; //ad-hoc (default display columns from a tab stop to the next)
+enum{WINDOW_MIN_ROWS = 3, WINDOW_MIN_COLUMNS = 8, RESIZE_SETTLING = 50}; //ad-hoc (settling: ms without SIGWINCH until a resize is taken as done)
+
 typedef struct _Window{
   int rows;
   int columns;
+  int tabWidth; //(1 to UCHAR_MAX, as Break.width)
   LineNumberPane lineNumnerPane;
   StatusPane statusPane;
   Scroll scroll;
-  char* frame;
+  Line* lines;
+  Builder scratch;
+  Builder frame;
+  Builder tokens; //a Token for each character of the row being drawn
+  int output; //where the frames are written (-1: nowhere, they are only built in "frame")
 } Window;
 
+typedef struct _Input{
+  int fd;
+  int head; //raw[head] to raw[size - 1] are read but not consumed yet
+  int size;
+  char raw[4096];
+  Builder paste;
+  sigset_t waiting; //signal mask while waiting for input, which lets SIGWINCH through (blocked otherwise)
+} Input;
+
+//keys for the headless mode, in place of a terminal
+typedef struct _Script{
+  int* keys; //(each PASTE_TEXT is followed by the length of its text)
+  int count;
+  int capacity;
+  Builder texts; //texts of the PASTE_TEXT keys, one after another
+} Script;
+
+typedef struct _Timing{
+  int count;
+  double total; //(seconds)
+  double longest;
+} Timing;
+
+enum{HISTOGRAM_BITS = 3, HISTOGRAM_STEPS = 1 << HISTOGRAM_BITS, HISTOGRAM_BUCKETS = 64 * HISTOGRAM_STEPS}; //(steps: buckets between a power of 2 and the next, within 12.5%)
+
+//counts of nanoseconds in buckets growing by powers of 2 (lock-free, so that any thread may add to it)
+typedef struct _Histogram{
+  unsigned long buckets[HISTOGRAM_BUCKETS];
+  unsigned long count;
+  unsigned long longest; //(ns)
+} Histogram;
+
+//how long each key took, from when it was read
+typedef struct _Latency{
+  Histogram paint; //until drawn on the screen (the first one of the keys drawn at once)
+  Histogram update; //in update()
+  Histogram draw; //in building the frame
+  Histogram write; //in writing the frame to the terminal
+} Latency;
+
 typedef enum _State{
   READY,
   RUNNING,
@@ -108,6 +572,14 @@ typedef struct _Editor{
   Cursor cursor;
   Buffer buffer;
   Clipboard clipboard;
+  History history;
+  Search search;
+  Prompt prompt;
+  Scan scan;
+  Replace replace;
+  Input input;
+  Journal journal;
+  Latency latency;
 } Editor;
 
 //(message: null-terminated required)
@@ -188,618 +660,4551 @@ void deactivateRegion(Editor* editor){
   }
 }
 
-void clearClipboard(Clipboard* clipboard){
-  Clip* current = clipboard->head;
-  while(current != NULL){
-    Clip* clip = current;
-    current = clip->next;
-    free(clip->row->raw);
-    free(clip->row);
-    free(clip);
+void initBuilder(int capacity, Builder* builder){
+  builder->capacity = capacity;
+  builder->size = 0;
+  builder->raw = malloc(sizeof(char) * builder->capacity);
+}
+
+//make room for "size" more bytes
+void reserve(int size, Builder* builder){
+  if(builder->capacity - builder->size < size){
+    int capacity = builder->capacity;
+    while(capacity - builder->size < size){
+      if(INT_MAX / 2 < capacity){
+        fprintf(stderr, "reserve(): too large\n");
+        abort();
+      }
+      capacity = (capacity < 64) ? 64 : capacity * 2; //ad-hoc
+    }
+    builder->raw = realloc(builder->raw, sizeof(char) * capacity);
+    builder->capacity = capacity;
   }
-  clipboard->head = NULL;
 }
 
-Row* createEmptyRow(int capacity){
-  Row* row = malloc(sizeof(Row));
-  row->capacity = capacity;
-  row->size = 0;
-  row->raw = malloc(sizeof(char) * row->capacity);
-  row->isEnabled = false;
-  return row;
+void appendBytes(const char* bytes, int length, Builder* builder){
+  reserve(length, builder);
+  memcpy(builder->raw + builder->size, bytes, length);
+  builder->size += length;
 }
 
-void setLineNumberOffsetBy(int bufferSize, LineNumberPane* pane){
-  int offset = 1;
-  int s = bufferSize;
-  while(s / 10 > 0){
-    ++offset;
-    s /= 10;
-  }
-  if(9 < offset)
-    offset = 9; //ad-hoc
+//(literal: string literal required)
+#define appendLiteral(literal, builder) appendBytes((literal), sizeof(literal) - 1, (builder))
 
-  pane->offset = offset;
-  pane->format[0] = '%';
-  pane->format[1] = '0' + offset;
-  pane->format[2] = 'd';
-  pane->format[3] = '\0';
+void appendString(const char* string, Builder* builder){
+  appendBytes(string, strlen(string), builder);
 }
 
-Editor* createEditor(){
-  Editor* editor = NULL;
+void appendCharacter(char character, Builder* builder){
+  reserve(1, builder);
+  builder->raw[builder->size] = character;
+  ++builder->size;
+}
 
-  struct winsize ws;
-  if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != -1){
-    editor = malloc(sizeof(Editor));
-    editor->state = READY;
+//append the decimal digits of "number", padded with spaces on the left up to "width"
+void appendPaddedNumber(int number, int width, Builder* builder){
+  char digits[12];
+  int n = 0;
+  unsigned int u = (number < 0) ? -(unsigned int)number : (unsigned int)number;
+  do{
+    digits[n++] = '0' + (u % 10);
+    u /= 10;
+  }while(u != 0);
+  if(number < 0)
+    digits[n++] = '-';
+
+  reserve((width > n ? width : n), builder);
+  for(int i = n; i < width; i++)
+    builder->raw[builder->size++] = ' ';
+  while(0 < n)
+    builder->raw[builder->size++] = digits[--n];
+}
 
-    editor->window.rows = ws.ws_row;
-    editor->window.columns = ws.ws_col;
-    editor->window.scroll.row = 0;
-    editor->window.scroll.column = 0;
-    editor->window.statusPane.rows = 2;
-    editor->window.statusPane.columns = editor->window.columns;
-    editor->window.statusPane.capacity = editor->window.columns;
-    editor->window.statusPane.message = malloc(sizeof(char) * editor->window.statusPane.capacity);
-    clearMessage(&(editor->window.statusPane));
-    editor->window.frame = malloc(sizeof(char) * ((editor->window.rows * editor->window.columns) + 1));
-    editor->window.frame[0] = '\0';
+void appendNumber(int number, Builder* builder){
+  appendPaddedNumber(number, 0, builder);
+}
 
-    editor->cursor.column = 0;
-    editor->cursor.row = 0;
+//(row, column: 1-based)
+void appendCursorPosition(int row, int column, Builder* builder){
+  appendLiteral("\x1b[", builder);
+  appendNumber(row, builder);
+  appendCharacter(';', builder);
+  appendNumber(column, builder);
+  appendCharacter('H', builder);
+}
 
-    editor->buffer.capacity = editor->window.rows;
-    editor->buffer.rows = malloc(sizeof(Row*) * editor->buffer.capacity);
-    Row* row = createEmptyRow(editor->window.columns);
-    editor->buffer.rows[0] = row;
-    editor->buffer.size = 1;
+//write all the bytes out at once
+bool flush(int fd, Builder* builder){
+  int written = 0;
+  while(written < builder->size){
+    ssize_t n = write(fd, builder->raw + written, builder->size - written);
+    if(n == -1){
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+    written += n;
+  }
+  builder->size = 0;
+  return true;
+}
 
-    deactivateRegion(editor);
+unsigned long stamp(){
+  static unsigned long last = 0;
+  return ++last;
+}
 
-    editor->clipboard.head = NULL;
+void touch(Row* row){
+  row->stamp = stamp();
+}
 
-    setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
-  }else{
-    perror("createEditor()");
-  }
-  return editor;
+void initArena(Arena* arena){
+  pthread_mutex_init(&(arena->lock), NULL);
+  arena->slabs = NULL;
+  arena->rest = NULL;
+  arena->restSize = 0;
+  arena->freeRows = NULL;
+  arena->freeSmallRows = NULL;
+  for(int i = 0; i < ARENA_CLASSES; i++)
+    arena->freePieces[i] = NULL;
+  arena->large = NULL;
 }
 
-void dispose(Editor* editor){
-  clearClipboard(&(editor->clipboard));
-  for(int i = 0; i < editor->buffer.size; i++){
-    free(editor->buffer.rows[i]->raw);
-    free(editor->buffer.rows[i]);
+//the arena which a row or a piece in a slab was cut from
+Arena* arenaOf(void* memory){
+  return ((Slab*)((uintptr_t)memory & ~(uintptr_t)(ARENA_SLAB - 1)))->arena;
+}
+
+//(size: a multiple of 8)
+void* cut(size_t size, Arena* arena){
+  if(arena->restSize < size){
+    void* memory;
+    if(posix_memalign(&memory, ARENA_SLAB, ARENA_SLAB) != 0)
+      return NULL;
+    Slab* slab = memory;
+    slab->next = arena->slabs;
+    slab->arena = arena;
+    arena->slabs = slab;
+    arena->rest = slab->raw;
+    arena->restSize = ARENA_SLAB - sizeof(Slab);
   }
-  free(editor->buffer.rows);
-  free(editor->window.statusPane.message);
-  free(editor->window.frame);
-  free(editor);
+  void* memory = arena->rest;
+  arena->rest += size;
+  arena->restSize -= size;
+  return memory;
 }
 
-void resetScreen(){
-  printf("\x1b[2J"); //clear screen
-  printf("\x1b[H"); //move cursor to home (top-left)
+//bytes of a piece of "class" (a power of 2, or halfway to the next one)
+size_t measureClass(int class){
+  return (size_t)(class % 2 == 0 ? ARENA_SMALLEST : ARENA_SMALLEST / 2 * 3) << (class / 2);
 }
 
-int readKey(){
-  const char CTRL = 0x1f; //(0001 1111)
-  int c = getchar();
-  switch(c){
-    case 8: //BS backspace or ctrl-h
-    case 127: //DEL
-      c = DELETE_LEFT;
-      break;
+//the smallest class of pieces which "size" bytes fit in, with the class before them (ARENA_CLASSES: none)
+int classOf(size_t size){
+  int class = 0;
+  while(class < ARENA_CLASSES && measureClass(class) < sizeof(size_t) + size)
+    ++class;
+  return class;
+}
 
-    case (CTRL & 'd'): //ctrl-d
-      c = DELETE_RIGHT;
-      break;
+void* allocate(size_t size, Arena* arena){
+  int class = classOf(size);
+  size_t* header;
+  pthread_mutex_lock(&(arena->lock));
+  if(class == ARENA_CLASSES){
+    Large* large = malloc(sizeof(Large) + sizeof(size_t) + size);
+    large->previous = NULL;
+    large->next = arena->large;
+    large->arena = arena;
+    if(arena->large != NULL)
+      arena->large->previous = large;
+    arena->large = large;
+    header = (size_t*)(large + 1);
+  }else if(arena->freePieces[class] != NULL){
+    header = arena->freePieces[class];
+    arena->freePieces[class] = *(void**)header;
+  }else{
+    header = cut(measureClass(class), arena);
+  }
+  pthread_mutex_unlock(&(arena->lock));
+  *header = class;
+  return header + 1;
+}
 
-    case 9: //TAB, \t and ctrl-i
-      //ToDo
-      break;
+//(back to the arena it came from)
+void deallocate(void* memory){
+  if(memory == NULL)
+    return;
+  size_t* header = (size_t*)memory - 1;
+  if(*header == ARENA_CLASSES){
+    Large* large = (Large*)header - 1;
+    Arena* arena = large->arena;
+    pthread_mutex_lock(&(arena->lock));
+    if(large->previous != NULL)
+      large->previous->next = large->next;
+    else
+      arena->large = large->next;
+    if(large->next != NULL)
+      large->next->previous = large->previous;
+    pthread_mutex_unlock(&(arena->lock));
+    free(large);
+  }else{
+    Arena* arena = arenaOf(header);
+    int class = (int)*header;
+    pthread_mutex_lock(&(arena->lock));
+    *(void**)header = arena->freePieces[class];
+    arena->freePieces[class] = header;
+    pthread_mutex_unlock(&(arena->lock));
+  }
+}
 
-    case 10: //LF line feed, \n and ctrl-j
-    case 13: //CR carriage return, \r and ctrl-m
-      c = NEWLINE;
-      break;
+//(hasSmall: with ROW_SMALL bytes after the row)
+Row* allocateRow(bool hasSmall, Arena* arena){
+  enum{SIZE = (sizeof(Row) + 7) / 8 * 8, SMALL_SIZE = (sizeof(Row) + ROW_SMALL + 7) / 8 * 8}; //(keeping the rows in a slab aligned)
+  void** list = hasSmall ? &(arena->freeSmallRows) : &(arena->freeRows);
+  pthread_mutex_lock(&(arena->lock));
+  Row* row = *list;
+  if(row != NULL)
+    *list = *(void**)row;
+  else
+    row = cut(hasSmall ? SMALL_SIZE : SIZE, arena);
+  pthread_mutex_unlock(&(arena->lock));
+  row->hasSmall = hasSmall;
+  return row;
+}
 
-    case (CTRL & 'e'): //ctrl-e
-      c = RIGHTMOST;
-      break;
+void deallocateRow(Row* row){
+  Arena* arena = arenaOf(row);
+  void** list = row->hasSmall ? &(arena->freeSmallRows) : &(arena->freeRows);
+  pthread_mutex_lock(&(arena->lock));
+  *(void**)row = *list;
+  *list = row;
+  pthread_mutex_unlock(&(arena->lock));
+}
 
-    case (CTRL & 'a'): //ctrl-a
-      c = LEFTMOST;
-      break;
+//free every row and piece at once (none may be used any longer)
+void clearArena(Arena* arena){
+  while(arena->slabs != NULL){
+    Slab* next = arena->slabs->next;
+    free(arena->slabs);
+    arena->slabs = next;
+  }
+  while(arena->large != NULL){
+    Large* next = arena->large->next;
+    free(arena->large);
+    arena->large = next;
+  }
+  arena->rest = NULL;
+  arena->restSize = 0;
+  arena->freeRows = NULL;
+  arena->freeSmallRows = NULL;
+  for(int i = 0; i < ARENA_CLASSES; i++)
+    arena->freePieces[i] = NULL;
+}
 
-    case (CTRL & 'f'): //ctrl-f
-      c = RIGHT;
-      break;
+//the capacity of a block taking up the whole piece that a block of "capacity" would take
+int fitCapacity(int capacity){
+  int class = classOf(sizeof(Block) + capacity);
+  if(class == ARENA_CLASSES)
+    return capacity;
+  return (int)(measureClass(class) - sizeof(size_t) - sizeof(Block));
+}
 
-    case (CTRL & 'b'): //ctrl-b
-      c = LEFT;
-      break;
+Block* createBlock(int capacity, Arena* arena){
+  Block* block = allocate(sizeof(Block) + sizeof(char) * capacity, arena);
+  block->references = 1;
+  return block;
+}
 
-    case (CTRL & 'n'): //ctrl-n
-      c = DOWN;
-      break;
+void retainBlock(Block* block){
+  ++block->references;
+}
 
-    case (CTRL & 'p'): //ctrl-p
-      c = UP;
-      break;
+void releaseBlock(Block* block){
+  if(--block->references == 0)
+    deallocate(block);
+}
 
-    case (CTRL & 'k'): //ctrl-k
-      c = DELETE_RIGHT_HALF;
-      break;
+//give a new row room for "capacity" characters, in the row itself if they are few
+//(capacity: at least, as the rest of the piece is taken as well)
+void provide(int capacity, Row* row){
+  if(row->hasSmall){
+    row->capacity = ROW_SMALL;
+    row->block = NULL;
+    row->raw = row->small;
+  }else{
+    row->capacity = fitCapacity(capacity);
+    row->block = createBlock(row->capacity, arenaOf(row));
+    row->raw = row->block->raw;
+  }
+}
 
-    case (CTRL & 'v'): //ctrl-v
-      c = DOWNWARD;
-      break;
+Row* createEmptyRow(int capacity, Arena* arena){
+  Row* row = allocateRow(capacity <= ROW_SMALL, arena);
+  provide(capacity, row);
+  row->size = 0;
+  row->gap = 0;
+  row->isEnabled = false;
+  row->isMapped = false;
+  row->measured = 0;
+  row->breakCount = 0;
+  row->breakCapacity = 0;
+  row->breaks = NULL;
+  touch(row);
+  return row;
+}
 
-    case '\x1b': //ESC
-      {
-        int c2 = getchar();
-        if(c2 == '['){
-          int c3 = getchar();
-          if(c3 == 'A')
-            c = UP;
-          else if(c3 == 'B')
-            c = DOWN;
-          else if(c3 == 'C')
-            c = RIGHT;
-          else if(c3 == 'D')
-            c = LEFT;
-        }else if(c2 == 'w'){ //alt-w
-          c = COPY_REGION;
-        }else if(c2 == 'v'){ //alt-v
-          c = UPWARD;
-        }
-      }
-      break;
+Row* createMappedRow(int line, Source* source, Arena* arena){
+  int size = source->offsets[line + 1] - source->offsets[line] - 1;
+  Row* row = allocateRow(false, arena); //(no room of its own until it gets edited, see editRow())
+  row->size = size;
+  row->capacity = row->size;
+  row->gap = row->size;
+  row->raw = source->map + source->offsets[line];
+  row->block = NULL;
+  row->isEnabled = (0 < row->size || line < source->lines - 1);
+  row->isMapped = true;
+  row->measured = 0;
+  row->breakCount = 0;
+  row->breakCapacity = 0;
+  row->breaks = NULL;
+  touch(row);
+  return row;
+}
 
-    case (CTRL & 'l'):
-      c = RECENTER;
-      break;
+void destroyRow(Row* row){
+  if(row->block != NULL)
+    releaseBlock(row->block);
+  deallocate(row->breaks);
+  deallocateRow(row);
+}
 
-    case (CTRL & 'g'): //ctrl-g
-      c = CANCEL_COMMAND;
-      break;
+//give a row its own copy of the characters before it gets edited (while it is mapped or shared with clips)
+void materialize(Row* row){
+  if(row->isMapped){
+    char* mapped = row->raw;
+    provide(row->size * 2, row); //ad-hoc
+    memcpy(row->raw, mapped, row->size);
+    row->gap = row->size;
+    row->isMapped = false;
+  }else if(row->block != NULL && 1 < row->block->references){
+    Block* block = createBlock(row->capacity, arenaOf(row));
+    int rest = row->size - row->gap;
+    memcpy(block->raw, row->raw, row->gap);
+    memcpy(block->raw + (row->capacity - rest), row->raw + (row->capacity - rest), rest);
+    releaseBlock(row->block);
+    row->block = block;
+    row->raw = block->raw;
+  }
+}
 
-    case (CTRL & ' '): //ctrl-space
-      c = ACTIVATE_REGION;
-      break;
+void releaseClips(Clip* head){
+  Clip* current = head;
+  while(current != NULL){
+    Clip* clip = current;
+    current = clip->next;
+    if(clip->block != NULL)
+      releaseBlock(clip->block);
+    free(clip);
+  }
+}
 
-    case (CTRL & 'w'): //ctrl-w
-      c = CUT_REGION;
-      break;
+void dropOldestKill(Clipboard* clipboard){
+  int oldest = (clipboard->latest - (clipboard->count - 1) + KILL_RING_CAPACITY) % KILL_RING_CAPACITY;
+  Kill* kill = &(clipboard->kills[oldest]);
+  releaseClips(kill->head);
+  clipboard->size -= kill->size;
+  kill->head = NULL;
+  kill->size = 0;
+  --clipboard->count;
+}
 
-    case (CTRL & 'y'): //ctrl-y
-      c = PASTE;
-      break;
+//put a kill on the ring as the most recent one (the ring keeps at least it even if it is over the limit)
+void keepKill(Clip* head, size_t size, Clipboard* clipboard){
+  if(clipboard->count == KILL_RING_CAPACITY)
+    dropOldestKill(clipboard);
+  clipboard->latest = (clipboard->latest + 1) % KILL_RING_CAPACITY;
+  clipboard->kills[clipboard->latest].head = head;
+  clipboard->kills[clipboard->latest].size = size;
+  ++clipboard->count;
+  clipboard->size += size;
+  while(clipboard->limit < clipboard->size && 1 < clipboard->count)
+    dropOldestKill(clipboard);
+}
 
-    case EOF:
-    case (CTRL & 'q'): //ctrl-q
-      c = QUIT;
-      break;
+void clearClipboard(Clipboard* clipboard){
+  while(0 < clipboard->count)
+    dropOldestKill(clipboard);
+  clipboard->yank = -1;
+}
 
-    default:
-      break;
+//room for a text of "length" bytes (a large text gets a chunk of its own)
+char* reserveText(size_t length, Record* record, History* history){
+  Chunk* chunk = history->chunk;
+  if(CHUNK_CAPACITY / 2 < length){
+    chunk = malloc(sizeof(Chunk) + length);
+    chunk->references = 0;
+    chunk->capacity = length;
+    chunk->size = 0;
+  }else if(chunk == NULL || chunk->capacity - chunk->size < length){
+    if(chunk != NULL && chunk->references == 0)
+      free(chunk);
+    chunk = malloc(sizeof(Chunk) + CHUNK_CAPACITY);
+    chunk->references = 0;
+    chunk->capacity = CHUNK_CAPACITY;
+    chunk->size = 0;
+    history->chunk = chunk;
   }
-//fprintf(stderr, "%x\n", c);
-  return c;
+  record->chunk = chunk;
+  record->offset = chunk->size;
+  record->length = length;
+  ++chunk->references;
+  chunk->size += length;
+  history->size += length;
+  return chunk->raw + record->offset;
 }
 
-void scroll(Editor* editor){
-  Cursor* cursor = &(editor->cursor);
-  Window* window = &(editor->window);
-  Scroll* scroll = &(window->scroll);
+void forgetText(Record* record, History* history){
+  Chunk* chunk = record->chunk;
+  if(chunk != NULL){
+    history->size -= record->length;
+    if(--chunk->references == 0 && chunk != history->chunk)
+      free(chunk);
+    record->chunk = NULL;
+  }
+}
 
-  int verticalOffset = window->statusPane.rows;
-  if(cursor->row < scroll->row) //scroll upward
-    scroll->row = cursor->row;
-  else if((cursor->row + 1) > scroll->row + (window->rows - verticalOffset)) //scroll downward
-    scroll->row = (cursor->row + 1) - (window->rows - verticalOffset);
+void forgetRecord(Record* record, History* history){
+  forgetText(record, history);
+  history->size -= sizeof(Record);
+}
 
-  int horizontalOffset = window->lineNumnerPane.offset;
-  if(cursor->column < scroll->column) //scroll left
-    scroll->column = cursor->column;
-  else if((cursor->column + 1) > scroll->column + (window->columns - horizontalOffset)) //scroll right
-    scroll->column = (cursor->column + 1) - (window->columns - horizontalOffset);
+//drop the records which have been undone
+void forgetRedo(History* history){
+  for(int i = history->done; i < history->count; i++)
+    forgetRecord(&(history->records[i]), history);
+  history->count = history->done;
 }
 
-void moveCursorUp(Editor* editor){
-  if(0 < editor->cursor.row){
-    --editor->cursor.row;
-    int r = editor->cursor.row;
-    Row* row = editor->buffer.rows[r];
-    if(editor->cursor.column > row->size)
-      editor->cursor.column = row->size;
+//drop old edits while they take too many bytes (the most recent one is kept anyway)
+//(the records of an edit are dropped together so that no undo is left half done)
+void trimHistory(History* history){
+  while(history->limit < history->size && history->first < history->latest){
+    do{
+      forgetRecord(&(history->records[history->first]), history);
+      ++history->first;
+    }while(history->first < history->latest && history->records[history->first].isChained);
   }
 }
 
-void moveCursorDown(Editor* editor){
-  if(editor->cursor.row == editor->buffer.size - 1){
-    int r = editor->cursor.row;
-    Row* row = editor->buffer.rows[r];
-    editor->cursor.column = row->size;
-  }else{
-    ++editor->cursor.row;
-    int r = editor->cursor.row;
-    Row* row = editor->buffer.rows[r];
-    if(editor->cursor.column > row->size)
-      editor->cursor.column = row->size;
-  }
+void clearHistory(History* history){
+  for(int i = history->first; i < history->count; i++)
+    forgetRecord(&(history->records[i]), history);
+  history->first = 0;
+  history->done = 0;
+  history->latest = 0;
+  history->count = 0;
+  free(history->chunk);
+  history->chunk = NULL;
 }
 
-void moveCursorDownward(Editor* editor){
-  int step = editor->window.rows - editor->window.statusPane.rows - 1;
-  int unseen = (editor->buffer.size - editor->window.scroll.row) - step;
-  if(0 < unseen){
-    if(unseen < step)
-      step = unseen;
-    for(int n = 0; n < step; n++){
-      moveCursorDown(editor);
-      ++(editor->window.scroll.row); //ad-hoc, ToDo: sync with cursor move
-    }
-  }
+char getCharacter(int at, Row* row){
+  if(at < row->gap)
+    return row->raw[at];
+  else
+    return row->raw[at + (row->capacity - row->size)];
 }
 
-void moveCursorUpward(Editor* editor){
-  int step = editor->window.rows - editor->window.statusPane.rows - 1;
-  if(editor->window.scroll.row < step)
-    step = editor->window.scroll.row;
-  for(int n = 0; n < step; n++){
-    moveCursorUp(editor);
-    --(editor->window.scroll.row); //ad-hoc, ToDo: sync with cursor move
+//copy characters from "from" to "to" (exclusive) across the gap
+void copyCharacters(Row* row, int from, int to, char* destination){
+  if(from < row->gap){
+    int n = (to < row->gap ? to : row->gap) - from;
+    memcpy(destination, row->raw + from, n);
+    destination += n;
+    from += n;
   }
+  if(from < to)
+    memcpy(destination, row->raw + from + (row->capacity - row->size), to - from);
 }
 
-void recenterCursor(Editor* editor){
-  int middle = (editor->window.rows - editor->window.statusPane.rows) / 2;
-  int current = editor->cursor.row - editor->window.scroll.row;
+//move the gap so that it begins right before the "at"-th character
+void shiftGap(int at, Row* row){
+  int length = row->capacity - row->size;
+  if(at < row->gap)
+    memmove(row->raw + at + length, row->raw + at, row->gap - at);
+  else if(row->gap < at)
+    memmove(row->raw + row->gap, row->raw + row->gap + length, at - row->gap);
+  row->gap = at;
+}
 
-  int offset = current - middle;
-  if(editor->window.scroll.row + offset >= 0)
-    editor->window.scroll.row += offset;
-  else
-    editor->window.scroll.row = 0;
+bool isPending(Row* slot){
+  return ((uintptr_t)slot & 1) == 1;
 }
 
-void moveCursorRight(Editor* editor){
+Row* tagLine(int line){
+  return (Row*)(((uintptr_t)line << 1) | 1);
+}
+
+//index of the slot which holds the "at"-th row
+int locate(int at, Buffer* buffer){
+  if(at < buffer->gap)
+    return at;
+  else
+    return at + (buffer->capacity - buffer->size);
+}
+
+Row* getRow(int at, Buffer* buffer){
+  int i = locate(at, buffer);
+  Row* row = buffer->rows[i];
+  if(isPending(row)){
+    row = createMappedRow((int)((uintptr_t)row >> 1), &(buffer->source), &(buffer->arena));
+    __atomic_store_n(&(buffer->rows[i]), row, __ATOMIC_RELEASE); //(workers of a scan may be looking at the slot)
+  }
+  return row;
+}
+
+void setRow(Row* row, int at, Buffer* buffer){
+  buffer->rows[locate(at, buffer)] = row;
+}
+
+//the row at "at", about to be edited
+//(a short mapped row is moved into a small one first, so that a few characters can be typed before it grows out of them)
+Row* editRow(int at, Buffer* buffer){
+  int i = locate(at, buffer);
+  Row* row = getRow(at, buffer);
+  if(row->isMapped && row->size < ROW_SMALL){
+    Row* small = allocateRow(true, &(buffer->arena));
+    *small = *row;
+    small->hasSmall = true;
+    small->isMapped = false;
+    provide(row->size, small);
+    memcpy(small->raw, row->raw, row->size);
+    deallocateRow(row);
+    buffer->rows[i] = small;
+    row = small;
+  }
+  return row;
+}
+
+View viewSlot(Row* row, Buffer* buffer){
+  View view;
+  if(isPending(row)){
+    Source* source = &(buffer->source);
+    int line = (int)((uintptr_t)row >> 1);
+    view.front = source->map + source->offsets[line];
+    view.frontSize = source->offsets[line + 1] - source->offsets[line] - 1;
+    view.back = NULL;
+    view.backSize = 0;
+  }else{
+    view.front = row->raw;
+    view.frontSize = row->gap;
+    view.back = row->raw + row->gap + (row->capacity - row->size);
+    view.backSize = row->size - row->gap;
+  }
+  return view;
+}
+
+//(it does not materialize the row)
+View viewRow(int at, Buffer* buffer){
+  return viewSlot(buffer->rows[locate(at, buffer)], buffer);
+}
+
+//viewRow() for workers, while the main thread may turn the slot into a row by getRow()
+View peekRow(int at, Buffer* buffer){
+  return viewSlot(__atomic_load_n(&(buffer->rows[locate(at, buffer)]), __ATOMIC_ACQUIRE), buffer);
+}
+
+//the characters of the "at"-th row (NULL: they are in Source.map or in the row itself)
+Block* getBlock(int at, Buffer* buffer){
+  Row* row = buffer->rows[locate(at, buffer)];
+  if(isPending(row) || row->isMapped)
+    return NULL;
+  else
+    return row->block;
+}
+
+//whether the "at"-th row keeps its characters in itself
+bool isSmall(int at, Buffer* buffer){
+  Row* row = buffer->rows[locate(at, buffer)];
+  return !isPending(row) && !row->isMapped && row->block == NULL;
+}
+
+//the "at"-th character of a view
+char viewCharacter(int at, View* view){
+  return (at < view->frontSize) ? view->front[at] : view->back[at - view->frontSize];
+}
+
+//characters from "from" to "to" (exclusive) of a view
+View sliceView(View view, int from, int to){
+  View slice;
+  if(from < view.frontSize){
+    slice.front = view.front + from;
+    slice.frontSize = (to < view.frontSize ? to : view.frontSize) - from;
+  }else{
+    slice.front = NULL;
+    slice.frontSize = 0;
+  }
+  if(view.frontSize < to){
+    int begin = (view.frontSize < from ? from : view.frontSize) - view.frontSize;
+    slice.back = view.back + begin;
+    slice.backSize = (to - view.frontSize) - begin;
+  }else{
+    slice.back = NULL;
+    slice.backSize = 0;
+  }
+  return slice;
+}
+
+//free the "at"-th row unless it has never been needed
+void releaseRow(int at, Buffer* buffer){
+  Row* row = buffer->rows[locate(at, buffer)];
+  if(!isPending(row))
+    destroyRow(row);
+}
+
+void addLength(int slot, size_t delta, Buffer* buffer){
+  for(int i = slot + 1; i <= buffer->capacity; i += i & -i)
+    buffer->lengths[i] += delta; //(wraps around for a negative one)
+}
+
+//the total length of the first "count" slots
+size_t sumLengths(int count, Buffer* buffer){
+  size_t sum = 0;
+  for(int i = count; 0 < i; i -= i & -i)
+    sum += buffer->lengths[i];
+  return sum;
+}
+
+size_t getLength(int slot, Buffer* buffer){
+  return sumLengths(slot + 1, buffer) - sumLengths(slot, buffer);
+}
+
+void setLength(int slot, size_t length, Buffer* buffer){
+  addLength(slot, length - getLength(slot, buffer), buffer);
+}
+
+//turn the plain lengths of the slots into the tree in place
+void buildLengths(Buffer* buffer){
+  for(int i = 1; i <= buffer->capacity; i++){
+    int j = i + (i & -i);
+    if(j <= buffer->capacity)
+      buffer->lengths[j] += buffer->lengths[i];
+  }
+}
+
+//turn the tree back into the plain lengths of the slots
+void flattenLengths(Buffer* buffer){
+  for(int i = buffer->capacity; 0 < i; i--){
+    int j = i + (i & -i);
+    if(j <= buffer->capacity)
+      buffer->lengths[j] -= buffer->lengths[i];
+  }
+}
+
+//whether so many slots are to be updated that rebuilding the whole tree is cheaper (O(capacity) against O(count log capacity))
+bool isBulk(int count, Buffer* buffer){
+  return buffer->capacity / 32 < count; //ad-hoc
+}
+
+//(after the characters of the "at"-th row have changed)
+//(the rows from "at" may have to be lexed again)
+void unsettle(int at, Buffer* buffer){
+  if(at < buffer->lexed)
+    buffer->lexed = at;
+}
+
+void indexRow(int at, Buffer* buffer){
+  View view = viewRow(at, buffer);
+  setLength(locate(at, buffer), view.frontSize + view.backSize + 1, buffer);
+  unsettle(at, buffer);
+}
+
+//where a point is in the text of the buffer (rows joined by newlines)
+size_t offsetOf(Point point, Buffer* buffer){
+  return sumLengths(locate(point.row, buffer), buffer) + point.column;
+}
+
+size_t countBytes(Buffer* buffer){
+  return sumLengths(buffer->capacity, buffer) - 1; //(no newline after the last row)
+}
+
+//the point at an offset in the text of the buffer (the end of the buffer if it is beyond)
+Point pointAt(size_t offset, Buffer* buffer){
+  int step = 1;
+  while(step * 2 <= buffer->capacity)
+    step *= 2;
+  //the slot which the offset falls in: the first one whose end is beyond the offset
+  int slot = 0;
+  size_t rest = offset;
+  for(; 0 < step; step /= 2){
+    if(slot + step <= buffer->capacity && buffer->lengths[slot + step] <= rest){
+      slot += step;
+      rest -= buffer->lengths[slot];
+    }
+  }
+
+  Point point;
+  if(slot < buffer->capacity){
+    point.row = (slot < buffer->gap) ? slot : slot - (buffer->capacity - buffer->size);
+    point.column = (int)rest;
+  }else{
+    View view = viewRow(buffer->size - 1, buffer);
+    point.row = buffer->size - 1;
+    point.column = view.frontSize + view.backSize;
+  }
+  return point;
+}
+
+//move the gap so that it begins right before the "at"-th row
+void moveGap(int at, Buffer* buffer){
+  int length = buffer->capacity - buffer->size;
+  //the lengths move along with the slots
+  if(0 < length && isBulk(abs(at - buffer->gap), buffer)){
+    flattenLengths(buffer);
+    size_t* lengths = buffer->lengths + 1;
+    if(at < buffer->gap)
+      memmove(lengths + at + length, lengths + at, sizeof(size_t) * (buffer->gap - at));
+    else if(buffer->gap < at)
+      memmove(lengths + buffer->gap, lengths + buffer->gap + length, sizeof(size_t) * (at - buffer->gap));
+    memset(lengths + at, 0, sizeof(size_t) * length);
+    buildLengths(buffer);
+  }else if(0 < length){
+    for(int i = buffer->gap - 1; at <= i; i--){
+      size_t moved = getLength(i, buffer);
+      addLength(i, -moved, buffer);
+      addLength(i + length, moved, buffer);
+    }
+    for(int i = buffer->gap + length; i < at + length; i++){
+      size_t moved = getLength(i, buffer);
+      addLength(i, -moved, buffer);
+      addLength(i - length, moved, buffer);
+    }
+  }
+
+  if(at < buffer->gap)
+    memmove(buffer->rows + at + length, buffer->rows + at, sizeof(Row*) * (buffer->gap - at));
+  else if(buffer->gap < at)
+    memmove(buffer->rows + buffer->gap, buffer->rows + buffer->gap + length, sizeof(Row*) * (at - buffer->gap));
+  buffer->gap = at;
+}
+
+void setLineNumberOffsetBy(int bufferSize, LineNumberPane* pane){
+  int offset = 1;
+  int s = bufferSize;
+  while(s / 10 > 0){
+    ++offset;
+    s /= 10;
+  }
+  if(9 < offset)
+    offset = 9; //ad-hoc
+
+  pane->offset = offset;
+}
+
+//(re)allocate what goes with the size of the window: the lines of the screen, the frame and the message
+//(the lines are drawn anew, and the message is cut short to the columns)
+void sizeWindow(int rows, int columns, Window* window){
+  for(int i = 0; i < window->rows; i++)
+    free(window->lines[i].text.raw);
+  free(window->lines);
+  window->rows = rows;
+  window->columns = columns;
+  window->lines = malloc(sizeof(Line) * rows);
+  for(int i = 0; i < rows; i++){
+    window->lines[i].isValid = false;
+    initBuilder(columns * 2, &(window->lines[i].text)); //ad-hoc
+  }
+  free(window->scratch.raw);
+  initBuilder(columns * 2, &(window->scratch)); //ad-hoc
+  free(window->frame.raw);
+  initBuilder(rows * columns * 2, &(window->frame)); //ad-hoc
+
+  StatusPane* statusPane = &(window->statusPane);
+  statusPane->columns = columns;
+  statusPane->capacity = columns;
+  statusPane->message = realloc(statusPane->message, sizeof(char) * statusPane->capacity);
+  statusPane->message[statusPane->capacity - 1] = '\0';
+}
+
+//(rows, columns: the size of the window, which is virtual in the headless mode)
+Editor* createSizedEditor(int rows, int columns){
+  Editor* editor = malloc(sizeof(Editor));
+  editor->state = READY;
+
+  editor->window.rows = 0;
+  editor->window.columns = 0;
+  editor->window.tabWidth = TAB_WIDTH;
+  editor->window.output = STDOUT_FILENO;
+  editor->window.scroll.row = 0;
+  editor->window.scroll.column = 0;
+  editor->window.statusPane.rows = 2;
+  editor->window.statusPane.message = NULL;
+  editor->window.lines = NULL;
+  editor->window.scratch.raw = NULL;
+  editor->window.frame.raw = NULL;
+  sizeWindow(rows, columns, &(editor->window));
+  clearMessage(&(editor->window.statusPane));
+  initBuilder(columns, &(editor->window.tokens)); //ad-hoc
+
+  editor->cursor.column = 0;
+  editor->cursor.row = 0;
+
+  editor->buffer.capacity = editor->window.rows;
+  editor->buffer.rows = malloc(sizeof(Row*) * editor->buffer.capacity);
+  editor->buffer.lengths = calloc(editor->buffer.capacity + 1, sizeof(size_t));
+  editor->buffer.states = malloc(sizeof(unsigned char) * editor->buffer.capacity);
+  initArena(&(editor->buffer.arena));
+  Row* row = createEmptyRow(0, &(editor->buffer.arena));
+  editor->buffer.rows[0] = row;
+  editor->buffer.size = 1;
+  editor->buffer.gap = 1;
+  indexRow(0, &(editor->buffer));
+  editor->buffer.source.path = NULL;
+  editor->buffer.source.map = NULL;
+  editor->buffer.source.length = 0;
+  editor->buffer.source.lines = 0;
+  editor->buffer.source.offsets = NULL;
+  editor->buffer.syntax = NULL;
+  editor->buffer.lexed = 0;
+
+  editor->buffer.region.isActive = true; //to be reset
+  deactivateRegion(editor);
+
+  for(int i = 0; i < KILL_RING_CAPACITY; i++){
+    editor->clipboard.kills[i].head = NULL;
+    editor->clipboard.kills[i].size = 0;
+  }
+  editor->clipboard.count = 0;
+  editor->clipboard.latest = KILL_RING_CAPACITY - 1;
+  editor->clipboard.size = 0;
+  editor->clipboard.limit = KILL_RING_LIMIT;
+  editor->clipboard.yank = -1;
+
+  editor->history.capacity = 64; //ad-hoc
+  editor->history.first = 0;
+  editor->history.done = 0;
+  editor->history.latest = 0;
+  editor->history.count = 0;
+  editor->history.records = malloc(sizeof(Record) * editor->history.capacity);
+  editor->history.chunk = NULL;
+  editor->history.size = 0;
+  editor->history.limit = HISTORY_LIMIT;
+
+  editor->journal.isEnabled = false;
+  editor->journal.path = NULL;
+  editor->journal.interval = JOURNAL_INTERVAL;
+
+  memset(&(editor->latency), 0, sizeof(Latency));
+
+  editor->search.isActive = false;
+  editor->search.isBackward = false;
+  editor->search.isFound = false;
+  initBuilder(64, &(editor->search.query)); //ad-hoc
+  initBuilder(64, &(editor->search.last)); //ad-hoc
+
+  editor->prompt.isActive = false;
+  editor->prompt.label = NULL;
+  initBuilder(64, &(editor->prompt.text)); //ad-hoc
+  editor->prompt.answer = NULL;
+
+  editor->scan.isRunning = false;
+  initBuilder(64, &(editor->scan.pattern)); //ad-hoc
+  editor->scan.hits.count = 0;
+  editor->scan.hits.capacity = 0;
+  editor->scan.hits.raw = NULL;
+
+  initBuilder(64, &(editor->replace.from)); //ad-hoc
+  initBuilder(64, &(editor->replace.to)); //ad-hoc
+  initBuilder(64, &(editor->replace.label)); //ad-hoc
+
+  editor->input.fd = STDIN_FILENO;
+  editor->input.head = 0;
+  editor->input.size = 0;
+  initBuilder(256, &(editor->input.paste)); //ad-hoc
+  pthread_sigmask(SIG_SETMASK, NULL, &(editor->input.waiting));
+  sigdelset(&(editor->input.waiting), SIGWINCH);
+
+  setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
+  return editor;
+}
+
+Editor* createEditor(){
+  struct winsize ws;
+  if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1){
+    perror("createEditor()");
+    return NULL;
+  }
+  return createSizedEditor(ws.ws_row, ws.ws_col);
+}
+
+void dispose(Editor* editor){
+  clearClipboard(&(editor->clipboard));
+  clearHistory(&(editor->history));
+  free(editor->history.records);
+  Buffer* buffer = &(editor->buffer);
+  clearArena(&(buffer->arena)); //(all the rows at once, after the kill ring)
+  pthread_mutex_destroy(&(buffer->arena.lock));
+  free(buffer->rows);
+  free(buffer->lengths);
+  free(buffer->states);
+  if(buffer->source.map != NULL)
+    munmap(buffer->source.map, buffer->source.length);
+  free(buffer->source.offsets);
+  free(buffer->source.path);
+  free(editor->window.statusPane.message);
+  for(int i = 0; i < editor->window.rows; i++)
+    free(editor->window.lines[i].text.raw);
+  free(editor->window.lines);
+  free(editor->window.scratch.raw);
+  free(editor->window.frame.raw);
+  free(editor->window.tokens.raw);
+  free(editor->scan.pattern.raw);
+  free(editor->scan.hits.raw);
+  free(editor->replace.from.raw);
+  free(editor->replace.to.raw);
+  free(editor->replace.label.raw);
+  free(editor->prompt.text.raw);
+  free(editor->search.query.raw);
+  free(editor->search.last.raw);
+  free(editor->input.paste.raw);
+  free(editor);
+}
+
+size_t countNewlines(const char* text, size_t length){
+  size_t n = 0;
+  const char* end = text + length;
+  const char* found = (0 < length) ? memchr(text, '\n', length) : NULL;
+  while(found != NULL){
+    ++n;
+    ++found;
+    found = (found < end) ? memchr(found, '\n', end - found) : NULL;
+  }
+  return n;
+}
+
+size_t* fillNewlines(const char* text, size_t length, size_t base, size_t* offsets){
+  const char* end = text + length;
+  const char* found = (0 < length) ? memchr(text, '\n', length) : NULL;
+  while(found != NULL){
+    ++found;
+    *offsets++ = base + (found - text);
+    found = (found < end) ? memchr(found, '\n', end - found) : NULL;
+  }
+  return offsets;
+}
+
+bool isAlwaysSupported(){
+  return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+size_t countNewlinesBySSE2(const char* text, size_t length){
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i zero = _mm_setzero_si128();
+  size_t n = 0;
+  size_t i = 0;
+  while(i + 16 <= length){
+    //each byte lane counts up to 255 matches before it is summed up
+    __m128i counts = zero;
+    for(int k = 0; k < 255 && i + 16 <= length; k++, i += 16){
+      __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+      counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(block, newline));
+    }
+    __m128i sums = _mm_sad_epu8(counts, zero);
+    n += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+  }
+  return n + countNewlines(text + i, length - i);
+}
+
+__attribute__((target("sse2")))
+size_t* fillNewlinesBySSE2(const char* text, size_t length, size_t base, size_t* offsets){
+  const __m128i newline = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for(; i + 16 <= length; i += 16){
+    __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+    while(mask != 0){
+      *offsets++ = base + i + __builtin_ctz(mask) + 1;
+      mask &= mask - 1;
+    }
+  }
+  return fillNewlines(text + i, length - i, base + i, offsets);
+}
+
+bool isSSE2Supported(){
+  return __builtin_cpu_supports("sse2");
+}
+
+__attribute__((target("avx2")))
+size_t countNewlinesByAVX2(const char* text, size_t length){
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i zero = _mm256_setzero_si256();
+  size_t n = 0;
+  size_t i = 0;
+  while(i + 32 <= length){
+    //each byte lane counts up to 255 matches before it is summed up
+    __m256i counts = zero;
+    for(int k = 0; k < 255 && i + 32 <= length; k++, i += 32){
+      __m256i block = _mm256_loadu_si256((const __m256i*)(text + i));
+      counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(block, newline));
+    }
+    uint64_t sums[4];
+    _mm256_storeu_si256((__m256i*)sums, _mm256_sad_epu8(counts, zero));
+    n += (size_t)(sums[0] + sums[1] + sums[2] + sums[3]);
+  }
+  return n + countNewlines(text + i, length - i);
+}
+
+__attribute__((target("avx2,bmi")))
+size_t* fillNewlinesByAVX2(const char* text, size_t length, size_t base, size_t* offsets){
+  const __m256i newline = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for(; i + 64 <= length; i += 64){
+    __m256i low = _mm256_loadu_si256((const __m256i*)(text + i));
+    __m256i high = _mm256_loadu_si256((const __m256i*)(text + i + 32));
+    uint64_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newline))
+                  | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newline)) << 32);
+    while(mask != 0){
+      *offsets++ = base + i + __builtin_ctzll(mask) + 1;
+      mask &= mask - 1;
+    }
+  }
+  return fillNewlinesBySSE2(text + i, length - i, base + i, offsets);
+}
+
+bool isAVX2Supported(){
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi");
+}
+#endif
+
+//from the most preferable one
+Indexer indexers[] = {
+#if defined(__x86_64__) || defined(__i386__)
+  {"avx2", isAVX2Supported, countNewlinesByAVX2, fillNewlinesByAVX2},
+  {"sse2", isSSE2Supported, countNewlinesBySSE2, fillNewlinesBySSE2},
+#endif
+  {"scalar", isAlwaysSupported, countNewlines, fillNewlines}
+};
+
+Indexer* chooseIndexer(){
+  static Indexer* chosen = NULL;
+  if(chosen == NULL){
+    int n = sizeof(indexers) / sizeof(Indexer);
+    for(int i = 0; i < n && chosen == NULL; i++){
+      if(indexers[i].isSupported())
+        chosen = &(indexers[i]);
+    }
+  }
+  return chosen;
+}
+
+int findBytes(const char* text, int length, const char* needle, int size){
+  if(length < size)
+    return -1;
+  const char* end = text + (length - size + 1); //(end of where a match can begin)
+  const char* found = memchr(text, needle[0], end - text);
+  while(found != NULL){
+    if(found[size - 1] == needle[size - 1] && memcmp(found, needle, size) == 0)
+      return found - text;
+    ++found;
+    found = (found < end) ? memchr(found, needle[0], end - found) : NULL;
+  }
+  return -1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+//candidates are where both the first byte and the last byte of the needle match
+__attribute__((target("sse2")))
+int findBytesBySSE2(const char* text, int length, const char* needle, int size){
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[size - 1]);
+  int i = 0;
+  for(; i + (size - 1) + 16 <= length; i += 16){
+    __m128i head = _mm_loadu_si128((const __m128i*)(text + i));
+    __m128i tail = _mm_loadu_si128((const __m128i*)(text + i + (size - 1)));
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+    while(mask != 0){
+      int at = i + __builtin_ctz(mask);
+      if(size <= 2 || memcmp(text + at + 1, needle + 1, size - 2) == 0)
+        return at;
+      mask &= mask - 1;
+    }
+  }
+  int found = findBytes(text + i, length - i, needle, size);
+  return (found == -1) ? -1 : i + found;
+}
+
+__attribute__((target("avx2")))
+int findBytesByAVX2(const char* text, int length, const char* needle, int size){
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[size - 1]);
+  int i = 0;
+  for(; i + (size - 1) + 32 <= length; i += 32){
+    __m256i head = _mm256_loadu_si256((const __m256i*)(text + i));
+    __m256i tail = _mm256_loadu_si256((const __m256i*)(text + i + (size - 1)));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+    while(mask != 0){
+      int at = i + __builtin_ctz(mask);
+      if(size <= 2 || memcmp(text + at + 1, needle + 1, size - 2) == 0)
+        return at;
+      mask &= mask - 1;
+    }
+  }
+  int found = findBytesBySSE2(text + i, length - i, needle, size);
+  return (found == -1) ? -1 : i + found;
+}
+#endif
+
+//from the most preferable one
+Finder finders[] = {
+#if defined(__x86_64__) || defined(__i386__)
+  {"avx2", isAVX2Supported, findBytesByAVX2},
+  {"sse2", isSSE2Supported, findBytesBySSE2},
+#endif
+  {"scalar", isAlwaysSupported, findBytes}
+};
+
+Finder* chooseFinder(){
+  static Finder* chosen = NULL;
+  if(chosen == NULL){
+    int n = sizeof(finders) / sizeof(Finder);
+    for(int i = 0; i < n && chosen == NULL; i++){
+      if(finders[i].isSupported())
+        chosen = &(finders[i]);
+    }
+  }
+  return chosen;
+}
+
+bool isPlain(const char* text, int length){
+  int i = 0;
+  for(; i + 8 <= length; i += 8){
+    uint64_t bytes;
+    memcpy(&bytes, text + i, 8);
+    uint64_t tabs = bytes ^ 0x0909090909090909ULL; //(a zero byte where a tab is)
+    if(((bytes | ((tabs - 0x0101010101010101ULL) & ~tabs)) & 0x8080808080808080ULL) != 0)
+      return false;
+  }
+  for(; i < length; i++){
+    if((text[i] & 0x80) != 0 || text[i] == '\t')
+      return false;
+  }
+  return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+//(a byte with its top bit set, or 0xFF where a tab is)
+__attribute__((target("sse2")))
+__m128i markBySSE2(const char* text, __m128i tabs){
+  __m128i bytes = _mm_loadu_si128((const __m128i*)text);
+  return _mm_or_si128(bytes, _mm_cmpeq_epi8(bytes, tabs));
+}
+
+__attribute__((target("sse2")))
+bool isPlainBySSE2(const char* text, int length){
+  __m128i tabs = _mm_set1_epi8('\t');
+  int i = 0;
+  for(; i + 64 <= length; i += 64){
+    __m128i a = _mm_or_si128(markBySSE2(text + i, tabs), markBySSE2(text + i + 16, tabs));
+    __m128i b = _mm_or_si128(markBySSE2(text + i + 32, tabs), markBySSE2(text + i + 48, tabs));
+    if(_mm_movemask_epi8(_mm_or_si128(a, b)) != 0)
+      return false;
+  }
+  for(; i + 16 <= length; i += 16){
+    if(_mm_movemask_epi8(markBySSE2(text + i, tabs)) != 0)
+      return false;
+  }
+  return isPlain(text + i, length - i);
+}
+
+__attribute__((target("avx2")))
+__m256i markByAVX2(const char* text, __m256i tabs){
+  __m256i bytes = _mm256_loadu_si256((const __m256i*)text);
+  return _mm256_or_si256(bytes, _mm256_cmpeq_epi8(bytes, tabs));
+}
+
+__attribute__((target("avx2")))
+bool isPlainByAVX2(const char* text, int length){
+  __m256i tabs = _mm256_set1_epi8('\t');
+  int i = 0;
+  for(; i + 128 <= length; i += 128){
+    __m256i a = _mm256_or_si256(markByAVX2(text + i, tabs), markByAVX2(text + i + 32, tabs));
+    __m256i b = _mm256_or_si256(markByAVX2(text + i + 64, tabs), markByAVX2(text + i + 96, tabs));
+    if(_mm256_movemask_epi8(_mm256_or_si256(a, b)) != 0)
+      return false;
+  }
+  for(; i + 32 <= length; i += 32){
+    if(_mm256_movemask_epi8(markByAVX2(text + i, tabs)) != 0)
+      return false;
+  }
+  return isPlainBySSE2(text + i, length - i);
+}
+#endif
+
+//from the most preferable one
+Checker checkers[] = {
+#if defined(__x86_64__) || defined(__i386__)
+  {"avx2", isAVX2Supported, isPlainByAVX2},
+  {"sse2", isSSE2Supported, isPlainBySSE2},
+#endif
+  {"scalar", isAlwaysSupported, isPlain}
+};
+
+Checker* chooseChecker(){
+  static Checker* chosen = NULL;
+  if(chosen == NULL){
+    int n = sizeof(checkers) / sizeof(Checker);
+    for(int i = 0; i < n && chosen == NULL; i++){
+      if(checkers[i].isSupported())
+        chosen = &(checkers[i]);
+    }
+  }
+  return chosen;
+}
+
+int addNode(NodeType type, int out, int out1, Compiler* compiler){
+  if(compiler->count == compiler->capacity){
+    compiler->capacity = (compiler->capacity == 0) ? 64 : compiler->capacity * 2; //ad-hoc
+    compiler->nodes = realloc(compiler->nodes, sizeof(Node) * compiler->capacity);
+  }
+  Node* node = &(compiler->nodes[compiler->count]);
+  node->type = type;
+  node->out = out;
+  node->out1 = out1;
+  node->set = -1;
+  return compiler->count++;
+}
+
+int addSet(Compiler* compiler){
+  compiler->bits = realloc(compiler->bits, sizeof(compiler->bits[0]) * (compiler->sets + 1));
+  memset(compiler->bits[compiler->sets], 0, sizeof(compiler->bits[0]));
+  return compiler->sets++;
+}
+
+void putByte(int byte, int set, Compiler* compiler){
+  compiler->bits[set][byte / 8] |= (unsigned char)(1 << (byte % 8));
+}
+
+bool hasByte(int byte, int set, Compiler* compiler){
+  return (compiler->bits[set][byte / 8] & (1 << (byte % 8))) != 0;
+}
+
+//\d, \w, \s and their complements \D, \W, \S
+bool putClass(char name, int set, Compiler* compiler){
+  if(strchr("dDwWsS", name) == NULL)
+    return false;
+  for(int b = 0; b < 256; b++){
+    bool has;
+    if(tolower(name) == 'd')
+      has = isdigit(b);
+    else if(tolower(name) == 'w')
+      has = isalnum(b) || b == '_';
+    else
+      has = isspace(b);
+    if(has != (bool)isupper(name))
+      putByte(b, set, compiler);
+  }
+  return true;
+}
+
+int unescape(char character){
+  if(character == 't')
+    return '\t';
+  else if(character == 'n')
+    return '\n';
+  else if(character == 'r')
+    return '\r';
+  else
+    return (unsigned char)character;
+}
+
+Fragment makeNode(NodeType type, int set, Compiler* compiler){
+  Fragment fragment;
+  fragment.end = addNode(EMPTY, -1, -1, compiler);
+  fragment.begin = addNode(type, fragment.end, -1, compiler);
+  compiler->nodes[fragment.begin].set = set;
+  return fragment;
+}
+
+//[...]
+Fragment parseClass(Compiler* compiler){
+  const char* pattern = compiler->pattern;
+  int set = addSet(compiler);
+  bool isNegated = false;
+  if(pattern[compiler->at] == '^'){
+    isNegated = true;
+    ++compiler->at;
+  }
+  bool isFirst = true; //(']' right after '[' is a character)
+  while(pattern[compiler->at] != '\0' && (pattern[compiler->at] != ']' || isFirst)){
+    isFirst = false;
+    int low;
+    if(pattern[compiler->at] == '\\' && pattern[compiler->at + 1] != '\0'){
+      char name = pattern[compiler->at + 1];
+      compiler->at += 2;
+      if(putClass(name, set, compiler))
+        continue;
+      low = unescape(name);
+    }else{
+      low = (unsigned char)pattern[compiler->at++];
+    }
+    int high = low;
+    if(pattern[compiler->at] == '-' && pattern[compiler->at + 1] != ']' && pattern[compiler->at + 1] != '\0'){
+      ++compiler->at;
+      if(pattern[compiler->at] == '\\' && pattern[compiler->at + 1] != '\0'){
+        high = unescape(pattern[compiler->at + 1]);
+        compiler->at += 2;
+      }else{
+        high = (unsigned char)pattern[compiler->at++];
+      }
+      if(high < low)
+        compiler->error = "bad range";
+    }
+    for(int b = low; b <= high; b++)
+      putByte(b, set, compiler);
+  }
+  if(pattern[compiler->at] == ']')
+    ++compiler->at;
+  else
+    compiler->error = "missing ]";
+  if(isNegated){
+    for(int i = 0; i < 32; i++)
+      compiler->bits[set][i] = ~compiler->bits[set][i];
+  }
+  return makeNode(SET, set, compiler);
+}
+
+Fragment parseAlternation(Compiler* compiler);
+
+Fragment parseAtom(Compiler* compiler){
+  const char* pattern = compiler->pattern;
+  char character = pattern[compiler->at++];
+  if(character == '('){
+    Fragment fragment = parseAlternation(compiler);
+    if(pattern[compiler->at] == ')')
+      ++compiler->at;
+    else
+      compiler->error = "missing )";
+    return fragment;
+  }else if(character == '['){
+    return parseClass(compiler);
+  }else if(character == '^'){
+    return makeNode(BEGIN, -1, compiler);
+  }else if(character == '$'){
+    return makeNode(END, -1, compiler);
+  }else if(character == '*' || character == '+' || character == '?'){
+    compiler->error = "nothing to repeat";
+    return makeNode(EMPTY, -1, compiler);
+  }
+
+  int set = addSet(compiler);
+  if(character == '.'){
+    for(int b = 0; b < 256; b++){
+      if(b != '\n')
+        putByte(b, set, compiler);
+    }
+  }else if(character == '\\'){
+    char name = pattern[compiler->at];
+    if(name == '\0'){
+      compiler->error = "trailing \\";
+    }else{
+      ++compiler->at;
+      if(!putClass(name, set, compiler))
+        putByte(unescape(name), set, compiler);
+    }
+  }else{
+    putByte((unsigned char)character, set, compiler);
+  }
+  return makeNode(SET, set, compiler);
+}
+
+Fragment parseRepetition(Compiler* compiler){
+  Fragment fragment = parseAtom(compiler);
+  char character = compiler->pattern[compiler->at];
+  while(compiler->error == NULL && (character == '*' || character == '+' || character == '?')){
+    int end = addNode(EMPTY, -1, -1, compiler);
+    int split = addNode(SPLIT, fragment.begin, end, compiler);
+    if(character == '*'){
+      compiler->nodes[fragment.end].out = split;
+      fragment.begin = split;
+    }else if(character == '+'){
+      compiler->nodes[fragment.end].out = split;
+    }else{ //'?'
+      compiler->nodes[fragment.end].out = end;
+      fragment.begin = split;
+    }
+    fragment.end = end;
+    character = compiler->pattern[++compiler->at];
+  }
+  return fragment;
+}
+
+Fragment parseConcatenation(Compiler* compiler){
+  Fragment fragment;
+  fragment.begin = addNode(EMPTY, -1, -1, compiler);
+  fragment.end = fragment.begin;
+  char character = compiler->pattern[compiler->at];
+  while(compiler->error == NULL && character != '\0' && character != '|' && character != ')'){
+    Fragment next = parseRepetition(compiler);
+    compiler->nodes[fragment.end].out = next.begin;
+    fragment.end = next.end;
+    character = compiler->pattern[compiler->at];
+  }
+  return fragment;
+}
+
+Fragment parseAlternation(Compiler* compiler){
+  Fragment fragment = parseConcatenation(compiler);
+  while(compiler->error == NULL && compiler->pattern[compiler->at] == '|'){
+    ++compiler->at;
+    Fragment other = parseConcatenation(compiler);
+    int end = addNode(EMPTY, -1, -1, compiler);
+    int split = addNode(SPLIT, fragment.begin, other.begin, compiler);
+    compiler->nodes[fragment.end].out = end;
+    compiler->nodes[other.end].out = end;
+    fragment.begin = split;
+    fragment.end = end;
+  }
+  return fragment;
+}
+
+//put "node" and the nodes which follow it without consuming a byte into "set"
+//(^ is passed only "atBeginning", and $ only "atEnd"; otherwise the END node itself is kept)
+void closure(int node, bool atBeginning, bool atEnd, Compiler* compiler, int* marks, int mark, int* stack, int* set, int* size){
+  int top = 0;
+  stack[top++] = node;
+  while(0 < top){
+    int n = stack[--top];
+    if(n == -1 || marks[n] == mark)
+      continue;
+    marks[n] = mark;
+    Node* current = &(compiler->nodes[n]);
+    if(current->type == EMPTY){
+      stack[top++] = current->out;
+    }else if(current->type == SPLIT){
+      stack[top++] = current->out;
+      stack[top++] = current->out1;
+    }else if(current->type == BEGIN){
+      if(atBeginning)
+        stack[top++] = current->out;
+    }else if(current->type == END && atEnd){
+      stack[top++] = current->out;
+    }else{ //SET, MATCH or END
+      set[(*size)++] = n;
+    }
+  }
+}
+
+int compareNumbers(const void* a, const void* b){
+  int x = *(const int*)a;
+  int y = *(const int*)b;
+  return (x > y) - (x < y);
+}
+
+//the state for "set" (-1: too many states)
+int intern(int* set, int size, Subsets* subsets){
+  qsort(set, size, sizeof(int), compareNumbers);
+  unsigned int hash = 2166136261u; //FNV-1a
+  for(int i = 0; i < size; i++)
+    hash = (hash ^ (unsigned int)set[i]) * 16777619u;
+  unsigned int slot = hash & subsets->mask;
+  while(subsets->table[slot] != -1){
+    int s = subsets->table[slot];
+    int n = subsets->begins[s + 1] - subsets->begins[s];
+    if(n == size && memcmp(subsets->pool + subsets->begins[s], set, sizeof(int) * size) == 0)
+      return s;
+    slot = (slot + 1) & subsets->mask;
+  }
+  if(subsets->count == MAX_STATES)
+    return -1;
+
+  if(subsets->poolCapacity < subsets->poolSize + size){
+    while(subsets->poolCapacity < subsets->poolSize + size)
+      subsets->poolCapacity *= 2; //ad-hoc
+    subsets->pool = realloc(subsets->pool, sizeof(int) * subsets->poolCapacity);
+  }
+  memcpy(subsets->pool + subsets->poolSize, set, sizeof(int) * size);
+  subsets->poolSize += size;
+  int s = subsets->count++;
+  subsets->begins[s + 1] = subsets->poolSize;
+  subsets->table[slot] = s;
+  return s;
+}
+
+//subset construction from the NFA ("isUnanchored": a match may begin at every byte)
+bool buildAutomaton(int start, bool isUnanchored, Compiler* compiler, Automaton* automaton){
+  //bytes which no set tells apart share a class
+  int classes[256] = {0};
+  int count = 1;
+  for(int set = 0; set < compiler->sets; set++){
+    int split[512];
+    for(int i = 0; i < count * 2; i++)
+      split[i] = -1;
+    int n = 0;
+    for(int b = 0; b < 256; b++){
+      int k = classes[b] * 2 + (hasByte(b, set, compiler) ? 1 : 0);
+      if(split[k] == -1)
+        split[k] = n++;
+      classes[b] = split[k];
+    }
+    count = n;
+  }
+  int representatives[256];
+  for(int b = 255; 0 <= b; b--)
+    representatives[classes[b]] = b;
+
+  Subsets subsets;
+  subsets.count = 0;
+  subsets.capacity = MAX_STATES + 1;
+  subsets.begins = malloc(sizeof(int) * subsets.capacity);
+  subsets.begins[0] = 0;
+  subsets.poolSize = 0;
+  subsets.poolCapacity = 256; //ad-hoc
+  subsets.pool = malloc(sizeof(int) * subsets.poolCapacity);
+  subsets.mask = MAX_STATES * 2 - 1;
+  subsets.table = malloc(sizeof(int) * (subsets.mask + 1));
+  for(int i = 0; i <= subsets.mask; i++)
+    subsets.table[i] = -1;
+
+  int* marks = calloc(compiler->count, sizeof(int));
+  int mark = 0;
+  int* stack = malloc(sizeof(int) * compiler->count * 2);
+  int* set = malloc(sizeof(int) * compiler->count);
+  int size = 0;
+  int capacity = 64; //ad-hoc
+  int* next = malloc(sizeof(int) * capacity * count);
+
+  intern(set, 0, &subsets); //the dead state
+  closure(start, true, false, compiler, marks, ++mark, stack, set, &size);
+  automaton->startAtBeginning = intern(set, size, &subsets);
+  size = 0;
+  closure(start, false, false, compiler, marks, ++mark, stack, set, &size);
+  automaton->start = intern(set, size, &subsets);
+
+  bool isBuilt = true;
+  for(int s = 0; s < subsets.count && isBuilt; s++){
+    if(capacity < subsets.count){
+      capacity *= 2;
+      next = realloc(next, sizeof(int) * capacity * count);
+    }
+    for(int k = 0; k < count && isBuilt; k++){
+      int b = representatives[k];
+      size = 0;
+      ++mark;
+      for(int i = subsets.begins[s]; i < subsets.begins[s + 1]; i++){
+        Node* node = &(compiler->nodes[subsets.pool[i]]);
+        if(node->type == SET && hasByte(b, node->set, compiler))
+          closure(node->out, false, false, compiler, marks, mark, stack, set, &size);
+      }
+      if(isUnanchored && s != 0)
+        closure(start, false, false, compiler, marks, mark, stack, set, &size);
+      int t = intern(set, size, &subsets);
+      if(t == -1)
+        isBuilt = false;
+      next[s * count + k] = t;
+    }
+  }
+
+  if(isBuilt){
+    automaton->states = subsets.count;
+    automaton->next = malloc(sizeof(int) * 256 * (unsigned int)subsets.count);
+    automaton->isAccepting = malloc(sizeof(bool) * (unsigned int)subsets.count);
+    automaton->isAcceptingAtEnd = malloc(sizeof(bool) * (unsigned int)subsets.count);
+    for(int s = 0; s < automaton->states; s++){
+      for(int b = 0; b < 256; b++)
+        automaton->next[s * 256 + b] = next[s * count + classes[b]];
+      automaton->isAccepting[s] = false;
+      automaton->isAcceptingAtEnd[s] = false;
+      size = 0;
+      ++mark;
+      for(int i = subsets.begins[s]; i < subsets.begins[s + 1]; i++){
+        int n = subsets.pool[i];
+        if(compiler->nodes[n].type == MATCH)
+          automaton->isAccepting[s] = true;
+        closure(n, false, true, compiler, marks, mark, stack, set, &size);
+      }
+      for(int i = 0; i < size; i++){
+        if(compiler->nodes[set[i]].type == MATCH)
+          automaton->isAcceptingAtEnd[s] = true;
+      }
+    }
+  }else{
+    compiler->error = "too complex";
+  }
+  free(next);
+  free(set);
+  free(stack);
+  free(marks);
+  free(subsets.table);
+  free(subsets.pool);
+  free(subsets.begins);
+  return isBuilt;
+}
+
+void freeAutomaton(Automaton* automaton){
+  free(automaton->next);
+  free(automaton->isAccepting);
+  free(automaton->isAcceptingAtEnd);
+}
+
+//(error: why it failed, if it fails)
+bool compileRegex(const char* pattern, Regex* regex, char** error){
+  Compiler compiler;
+  compiler.pattern = pattern;
+  compiler.at = 0;
+  compiler.count = 0;
+  compiler.capacity = 0;
+  compiler.nodes = NULL;
+  compiler.sets = 0;
+  compiler.bits = NULL;
+  compiler.error = NULL;
+
+  Fragment fragment = parseAlternation(&compiler);
+  if(compiler.error == NULL && pattern[compiler.at] != '\0')
+    compiler.error = "unmatched )";
+  if(compiler.error == NULL){
+    compiler.nodes[fragment.end].out = addNode(MATCH, -1, -1, &compiler);
+    if(buildAutomaton(fragment.begin, false, &compiler, &(regex->anchored))){
+      if(!buildAutomaton(fragment.begin, true, &compiler, &(regex->unanchored)))
+        freeAutomaton(&(regex->anchored));
+    }
+  }
+  *error = compiler.error;
+  free(compiler.nodes);
+  free(compiler.bits);
+  return compiler.error == NULL;
+}
+
+void freeRegex(Regex* regex){
+  freeAutomaton(&(regex->anchored));
+  freeAutomaton(&(regex->unanchored));
+}
+
+//where the longest match from "from" ends (-1: no match)
+int matchAt(Regex* regex, View* view, int from){
+  Automaton* automaton = &(regex->anchored);
+  int size = view->frontSize + view->backSize;
+  int state = (from == 0) ? automaton->startAtBeginning : automaton->start;
+  int end = -1;
+  for(int c = from; state != 0; c++){
+    if(automaton->isAccepting[state] || (c == size && automaton->isAcceptingAtEnd[state]))
+      end = c;
+    if(c == size)
+      break;
+    unsigned char b = (c < view->frontSize) ? view->front[c] : view->back[c - view->frontSize];
+    state = automaton->next[state * 256 + b];
+  }
+  return end;
+}
+
+bool hasMatch(Regex* regex, View* view){
+  Automaton* automaton = &(regex->unanchored);
+  int state = automaton->startAtBeginning;
+  const unsigned char* pieces[2] = {(const unsigned char*)view->front, (const unsigned char*)view->back};
+  int sizes[2] = {view->frontSize, view->backSize};
+  for(int p = 0; p < 2; p++){
+    for(int i = 0; i < sizes[p]; i++){
+      if(automaton->isAccepting[state])
+        return true;
+      state = automaton->next[state * 256 + pieces[p][i]];
+      if(state == 0)
+        return false;
+    }
+  }
+  return automaton->isAccepting[state] || automaton->isAcceptingAtEnd[state];
+}
+
+int countProcessors(){
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if(n < 1)
+    n = 1;
+  else if(64 < n)
+    n = 64; //ad-hoc
+  return (int)n;
+}
+
+void* countSection(void* argument){
+  Section* section = argument;
+  section->count = section->indexer->count(section->text + section->begin, section->end - section->begin);
+  return NULL;
+}
+
+void* fillSection(void* argument){
+  Section* section = argument;
+  section->indexer->fill(section->text + section->begin, section->end - section->begin, section->begin, section->offsets);
+  return NULL;
+}
+
+//run "work" on each section in a thread of its own (on a section in this thread, if its thread cannot be created)
+void runSections(void* (*work)(void*), Section* sections, int threads){
+  if(threads == 1){
+    work(&(sections[0]));
+    return;
+  }
+  pthread_t* workers = malloc(sizeof(pthread_t) * threads);
+  bool* isStarted = malloc(sizeof(bool) * threads);
+  for(int t = 0; t < threads; t++){
+    isStarted[t] = (pthread_create(&(workers[t]), NULL, work, &(sections[t])) == 0);
+    if(!isStarted[t])
+      work(&(sections[t]));
+  }
+  for(int t = 0; t < threads; t++){
+    if(isStarted[t])
+      pthread_join(workers[t], NULL);
+  }
+  free(isStarted);
+  free(workers);
+}
+
+//build the table of offsets where each line begins
+//(threads: the text is split into that many sections which are indexed in parallel, if it is large enough)
+size_t* indexLines(Indexer* indexer, char* text, size_t length, size_t* lines, int threads){
+  const size_t minimum = 16 * 1024 * 1024; //ad-hoc, bytes per thread
+  if(length / minimum < (size_t)threads)
+    threads = (int)(length / minimum);
+  if(threads < 1)
+    threads = 1;
+
+  Section* sections = malloc(sizeof(Section) * threads);
+  for(int t = 0; t < threads; t++){
+    sections[t].indexer = indexer;
+    sections[t].text = text;
+    sections[t].begin = length / threads * t;
+    sections[t].end = (t == threads - 1) ? length : length / threads * (t + 1);
+  }
+
+  //1st pass: count newlines so that the table is allocated at once
+  runSections(countSection, sections, threads);
+  size_t n = 1;
+  for(int t = 0; t < threads; t++)
+    n += sections[t].count;
+
+  //2nd pass: each section fills its own part of the table
+  size_t* offsets = malloc(sizeof(size_t) * (n + 1));
+  offsets[0] = 0;
+  size_t filled = 1;
+  for(int t = 0; t < threads; t++){
+    sections[t].offsets = offsets + filled;
+    filled += sections[t].count;
+  }
+  runSections(fillSection, sections, threads);
+  offsets[n] = length + 1;
+
+  free(sections);
+  *lines = n;
+  return offsets;
+}
+
+enum{C_CODE, C_COMMENT, C_LINE_COMMENT, C_STRING}; //lexer states of C at the end of a row (what goes on to the next row)
+
+void putToken(Token token, int from, int to, char* tokens){
+  if(tokens != NULL)
+    memset(tokens + from, token, to - from);
+}
+
+//a keyword or a type of C and C++ (PLAIN: neither)
+Token classifyWord(int at, int length, View* view){
+  static const struct{
+    char* word;
+    Token token;
+  } words[] = { //(in the order of strcmp())
+    {"FILE", TYPE}, {"NULL", KEYWORD}, {"_Alignas", KEYWORD}, {"_Alignof", KEYWORD}, {"_Atomic", KEYWORD},
+    {"_Bool", TYPE}, {"_Complex", TYPE}, {"_Generic", KEYWORD}, {"_Noreturn", KEYWORD},
+    {"_Static_assert", KEYWORD}, {"_Thread_local", KEYWORD}, {"alignas", KEYWORD}, {"alignof", KEYWORD},
+    {"asm", KEYWORD}, {"auto", KEYWORD}, {"bool", TYPE}, {"break", KEYWORD}, {"case", KEYWORD},
+    {"catch", KEYWORD}, {"char", TYPE}, {"char16_t", TYPE}, {"char32_t", TYPE}, {"char8_t", TYPE},
+    {"class", KEYWORD}, {"co_await", KEYWORD}, {"co_return", KEYWORD}, {"co_yield", KEYWORD},
+    {"const", KEYWORD}, {"const_cast", KEYWORD}, {"consteval", KEYWORD}, {"constexpr", KEYWORD},
+    {"constinit", KEYWORD}, {"continue", KEYWORD}, {"decltype", KEYWORD}, {"default", KEYWORD},
+    {"delete", KEYWORD}, {"do", KEYWORD}, {"double", TYPE}, {"dynamic_cast", KEYWORD}, {"else", KEYWORD},
+    {"enum", KEYWORD}, {"explicit", KEYWORD}, {"export", KEYWORD}, {"extern", KEYWORD}, {"false", KEYWORD},
+    {"final", KEYWORD}, {"float", TYPE}, {"for", KEYWORD}, {"friend", KEYWORD}, {"goto", KEYWORD},
+    {"if", KEYWORD}, {"inline", KEYWORD}, {"int", TYPE}, {"int16_t", TYPE}, {"int32_t", TYPE},
+    {"int64_t", TYPE}, {"int8_t", TYPE}, {"intptr_t", TYPE}, {"long", TYPE}, {"mutable", KEYWORD},
+    {"namespace", KEYWORD}, {"new", KEYWORD}, {"noexcept", KEYWORD}, {"nullptr", KEYWORD},
+    {"operator", KEYWORD}, {"override", KEYWORD}, {"private", KEYWORD}, {"protected", KEYWORD},
+    {"ptrdiff_t", TYPE}, {"public", KEYWORD}, {"register", KEYWORD}, {"reinterpret_cast", KEYWORD},
+    {"requires", KEYWORD}, {"restrict", KEYWORD}, {"return", KEYWORD}, {"short", TYPE}, {"signed", TYPE},
+    {"size_t", TYPE}, {"sizeof", KEYWORD}, {"ssize_t", TYPE}, {"static", KEYWORD}, {"static_assert", KEYWORD},
+    {"static_cast", KEYWORD}, {"struct", KEYWORD}, {"switch", KEYWORD}, {"template", KEYWORD},
+    {"this", KEYWORD}, {"thread_local", KEYWORD}, {"throw", KEYWORD}, {"true", KEYWORD}, {"try", KEYWORD},
+    {"typedef", KEYWORD}, {"typeid", KEYWORD}, {"typename", KEYWORD}, {"uint16_t", TYPE}, {"uint32_t", TYPE},
+    {"uint64_t", TYPE}, {"uint8_t", TYPE}, {"uintptr_t", TYPE}, {"union", KEYWORD}, {"unsigned", TYPE},
+    {"using", KEYWORD}, {"virtual", KEYWORD}, {"void", TYPE}, {"volatile", KEYWORD}, {"wchar_t", TYPE},
+    {"while", KEYWORD}
+  };
+  char word[20]; //ad-hoc (longer than any of the words)
+  if((int)sizeof(word) <= length)
+    return PLAIN;
+  for(int i = 0; i < length; i++)
+    word[i] = viewCharacter(at + i, view);
+  word[length] = '\0';
+  int low = 0;
+  int high = sizeof(words) / sizeof(words[0]);
+  while(low < high){
+    int middle = low + (high - low) / 2;
+    int order = strcmp(word, words[middle].word);
+    if(order == 0)
+      return words[middle].token;
+    else if(order < 0)
+      high = middle;
+    else
+      low = middle + 1;
+  }
+  return PLAIN;
+}
+
+//where a block comment whose body begins at "at" ends, after "*/" (-1: not in the row)
+int endOfComment(int at, View* view){
+  int size = view->frontSize + view->backSize;
+  for(int i = at; i + 1 < size; i++){
+    if(viewCharacter(i, view) == '*' && viewCharacter(i + 1, view) == '/')
+      return i + 2;
+  }
+  return -1;
+}
+
+//where a quoted literal whose body begins at "at" ends, after the closing quote (-1: not in the row)
+int endOfQuoted(int at, char quote, View* view){
+  int size = view->frontSize + view->backSize;
+  for(int i = at; i < size; i++){
+    char c = viewCharacter(i, view);
+    if(c == '\\')
+      ++i;
+    else if(c == quote)
+      return i + 1;
+  }
+  return -1;
+}
+
+bool isWordCharacter(char c){
+  return isalnum((unsigned char)c) || c == '_';
+}
+
+//whether the characters from "at" are just the word
+bool isWordAt(const char* word, int at, int length, View* view){
+  if((int)strlen(word) != length)
+    return false;
+  for(int i = 0; i < length; i++){
+    if(viewCharacter(at + i, view) != word[i])
+      return false;
+  }
+  return true;
+}
+
+//ad-hoc: neither trigraphs nor raw string literals
+unsigned char lexC(View* view, unsigned char state, char* tokens){
+  int size = view->frontSize + view->backSize;
+  bool isContinued = (0 < size && viewCharacter(size - 1, view) == '\\'); //(a backslash at the end joins the next row)
+  int i = 0;
+  if(state == C_LINE_COMMENT){
+    putToken(COMMENT, 0, size, tokens);
+    return isContinued ? C_LINE_COMMENT : C_CODE;
+  }else if(state == C_COMMENT){
+    i = endOfComment(0, view);
+    if(i == -1){
+      putToken(COMMENT, 0, size, tokens);
+      return C_COMMENT;
+    }
+    putToken(COMMENT, 0, i, tokens);
+  }else if(state == C_STRING){
+    i = endOfQuoted(0, '"', view);
+    if(i == -1){
+      putToken(STRING, 0, size, tokens);
+      return isContinued ? C_STRING : C_CODE;
+    }
+    putToken(STRING, 0, i, tokens);
+  }
+  putToken(PLAIN, i, size, tokens);
+
+  bool isFirst = (state != C_STRING); //(nothing but spaces or comments so far, where a directive may begin)
+  bool isInclude = false; //(<...> is a header name)
+  while(i < size){
+    char c = viewCharacter(i, view);
+    char next = (i + 1 < size) ? viewCharacter(i + 1, view) : '\0';
+    if(c == ' ' || c == '\t'){
+      ++i;
+      continue;
+    }
+    if(c == '/' && next == '/'){
+      putToken(COMMENT, i, size, tokens);
+      return isContinued ? C_LINE_COMMENT : C_CODE;
+    }else if(c == '/' && next == '*'){
+      int end = endOfComment(i + 2, view);
+      if(end == -1){
+        putToken(COMMENT, i, size, tokens);
+        return C_COMMENT;
+      }
+      putToken(COMMENT, i, end, tokens);
+      i = end;
+      continue;
+    }
+
+    if(c == '"' || c == '\''){
+      int end = endOfQuoted(i + 1, c, view);
+      if(end == -1){
+        putToken(STRING, i, size, tokens);
+        return (c == '"' && isContinued) ? C_STRING : C_CODE;
+      }
+      putToken(STRING, i, end, tokens);
+      i = end;
+    }else if(c == '#' && isFirst){
+      int end = i + 1;
+      while(end < size && (viewCharacter(end, view) == ' ' || viewCharacter(end, view) == '\t'))
+        ++end;
+      int word = end;
+      while(end < size && isWordCharacter(viewCharacter(end, view)))
+        ++end;
+      isInclude = isWordAt("include", word, end - word, view);
+      putToken(DIRECTIVE, i, end, tokens);
+      i = end;
+    }else if(c == '<' && isInclude){
+      int end = i + 1;
+      while(end < size && viewCharacter(end, view) != '>')
+        ++end;
+      end = (end < size) ? end + 1 : size;
+      putToken(STRING, i, end, tokens);
+      i = end;
+    }else if(isdigit((unsigned char)c) || (c == '.' && isdigit((unsigned char)next))){
+      bool isHex = (c == '0' && (next == 'x' || next == 'X'));
+      int end = i + 1;
+      while(end < size){
+        char d = viewCharacter(end, view);
+        char previous = viewCharacter(end - 1, view);
+        if(isWordCharacter(d) || d == '.' || d == '\''){ //(' separates digits in C++14)
+          ++end;
+        }else if((d == '+' || d == '-') && (isHex ? (previous == 'p' || previous == 'P') : (previous == 'e' || previous == 'E'))){
+          ++end;
+        }else{
+          break;
+        }
+      }
+      putToken(NUMBER, i, end, tokens);
+      i = end;
+    }else if(isWordCharacter(c)){
+      int end = i + 1;
+      while(end < size && isWordCharacter(viewCharacter(end, view)))
+        ++end;
+      if(tokens != NULL)
+        putToken(classifyWord(i, end - i, view), i, end, tokens);
+      i = end;
+    }else{
+      ++i;
+    }
+    isFirst = false;
+  }
+  return C_CODE;
+}
+
+//from the most preferable one
+Syntax syntaxes[] = {
+  {"c", " .c .h .cc .cpp .cxx .hh .hpp .hxx ", lexC}
+};
+
+//a syntax by the extension of a file name (NULL: none)
+Syntax* chooseSyntax(const char* path){
+  const char* name = strrchr(path, '/');
+  name = (name == NULL) ? path : name + 1;
+  const char* extension = strrchr(name, '.');
+  if(extension == NULL || extension == name || 16 < strlen(extension)) //ad-hoc
+    return NULL;
+  char enclosed[20];
+  snprintf(enclosed, sizeof(enclosed), " %s ", extension);
+  int n = sizeof(syntaxes) / sizeof(Syntax);
+  for(int i = 0; i < n; i++){
+    if(strstr(syntaxes[i].extensions, enclosed) != NULL)
+      return &(syntaxes[i]);
+  }
+  return NULL;
+}
+
+//the lexer state at the beginning of the "at"-th row
+//(going on from the settled rows, through their views, so that no row is made for a line only to be lexed)
+unsigned char stateAt(int at, Buffer* buffer){
+  int r = (at < buffer->lexed) ? at : buffer->lexed;
+  unsigned char state = (0 < r) ? buffer->states[r - 1] : 0;
+  for(; r < at; r++){
+    View view = viewRow(r, buffer);
+    state = buffer->syntax->lex(&view, state, NULL);
+    buffer->states[r] = state;
+  }
+  if(buffer->lexed < at)
+    buffer->lexed = at;
+  return state;
+}
+
+//(path: null-terminated required)
+bool openFile(char* path, Editor* editor){
+  Buffer* buffer = &(editor->buffer);
+  Source* source = &(buffer->source);
+  StatusPane* statusPane = &(editor->window.statusPane);
+  buffer->syntax = chooseSyntax(path);
+
+  int fd = open(path, O_RDONLY);
+  if(fd == -1){
+    if(errno == ENOENT){
+      source->path = strdup(path);
+      setMessage("(new file)", statusPane);
+    }else{
+      setMessage(strerror(errno), statusPane);
+    }
+    return false;
+  }
+
+  struct stat status;
+  if(fstat(fd, &status) == -1 || !S_ISREG(status.st_mode)){
+    setMessage("(not a regular file)", statusPane);
+    close(fd);
+    return false;
+  }
+  char* map = NULL;
+  size_t length = status.st_size;
+  if(0 < length){
+    map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED){
+      setMessage(strerror(errno), statusPane);
+      close(fd);
+      return false;
+    }
+  }
+  close(fd);
+
+  size_t lines;
+  size_t* offsets = indexLines(chooseIndexer(), map, length, &lines, countProcessors());
+  if((size_t)(INT_MAX - editor->window.rows) <= lines){
+    setMessage("(too many lines)", statusPane);
+    free(offsets);
+    if(map != NULL)
+      munmap(map, length);
+    return false;
+  }
+  source->path = strdup(path);
+  source->map = map;
+  source->length = length;
+  source->lines = (int)lines;
+  source->offsets = offsets;
+
+  //replace the initial empty row with the lines of the file, each of which is materialized lazily
+  for(int i = 0; i < buffer->size; i++)
+    releaseRow(i, buffer);
+  free(buffer->rows);
+  buffer->capacity = source->lines + editor->window.rows;
+  buffer->rows = malloc(sizeof(Row*) * buffer->capacity);
+  for(int i = 0; i < source->lines; i++)
+    buffer->rows[i] = tagLine(i);
+  buffer->size = source->lines;
+  buffer->gap = source->lines;
+  free(buffer->lengths);
+  buffer->lengths = calloc(buffer->capacity + 1, sizeof(size_t));
+  for(int i = 0; i < source->lines; i++)
+    buffer->lengths[i + 1] = offsets[i + 1] - offsets[i]; //(a line and its newline)
+  buildLengths(buffer);
+  free(buffer->states);
+  buffer->states = malloc(sizeof(unsigned char) * buffer->capacity);
+  buffer->lexed = 0;
+
+  setLineNumberOffsetBy(buffer->size, &(editor->window.lineNumnerPane));
+  return true;
+}
+
+//write all the vectors, continuing after partial writes
+bool writeVectors(int fd, struct iovec* vectors, int count){
+  while(0 < count){
+    ssize_t written = writev(fd, vectors, count);
+    if(written == -1){
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+    while(0 < count && (size_t)written >= vectors->iov_len){
+      written -= vectors->iov_len;
+      ++vectors;
+      --count;
+    }
+    if(0 < count){
+      vectors->iov_base = (char*)vectors->iov_base + written;
+      vectors->iov_len -= written;
+    }
+  }
+  return true;
+}
+
+//write the rows straight from their storage, many rows per writev()
+bool writeRows(int fd, Buffer* buffer){
+  enum{BATCH = 1023}; //ad-hoc, (within IOV_MAX)
+  static char newline[] = "\n";
+  struct iovec vectors[BATCH];
+  int count = 0;
+  for(int r = 0; r < buffer->size; r++){
+    View view = viewRow(r, buffer);
+    if(0 < view.frontSize){
+      vectors[count].iov_base = view.front;
+      vectors[count].iov_len = view.frontSize;
+      ++count;
+    }
+    if(0 < view.backSize){
+      vectors[count].iov_base = view.back;
+      vectors[count].iov_len = view.backSize;
+      ++count;
+    }
+    if(r < buffer->size - 1){
+      vectors[count].iov_base = newline;
+      vectors[count].iov_len = 1;
+      ++count;
+    }
+    if(BATCH - 3 < count || r == buffer->size - 1){
+      if(!writeVectors(fd, vectors, count))
+        return false;
+      count = 0;
+    }
+  }
+  return true;
+}
+
+//an entry of the journal with room for "length" bytes of text after it
+Entry* createEntry(size_t length){
+  Entry* entry = malloc(sizeof(Entry) + length);
+  entry->next = NULL;
+  entry->isSave = false;
+  entry->length = length;
+  return entry;
+}
+
+//(the main thread's) an entry goes to the worker of the journal
+void putEntry(Entry* entry, Journal* journal){
+  __atomic_store_n(&(journal->tail->next), entry, __ATOMIC_RELEASE); //(the worker may be looking at the tail)
+  journal->tail = entry;
+}
+
+//(after the file has been saved as "status" says)
+void journalSave(struct stat* status, Editor* editor){
+  Journal* journal = &(editor->journal);
+  if(!journal->isEnabled)
+    return;
+  Entry* entry = createEntry(0);
+  entry->isSave = true;
+  entry->size = status->st_size;
+  entry->modified = status->st_mtime;
+  putEntry(entry, journal);
+}
+
+//write into a temporary file next to the target, then rename it over the target
+bool saveFile(Editor* editor){
+  Source* source = &(editor->buffer.source);
+  StatusPane* statusPane = &(editor->window.statusPane);
+  if(source->path == NULL){
+    setMessage("(no file name)", statusPane);
+    return false;
+  }
+
+  size_t length = strlen(source->path);
+  char* temporary = malloc(length + sizeof(".XXXXXX"));
+  memcpy(temporary, source->path, length);
+  memcpy(temporary + length, ".XXXXXX", sizeof(".XXXXXX"));
+  int fd = mkstemp(temporary);
+  if(fd == -1){
+    setMessage(strerror(errno), statusPane);
+    free(temporary);
+    return false;
+  }
+
+  //keep the permission of the target (mkstemp() creates a file with 0600)
+  struct stat status;
+  mode_t mode;
+  if(stat(source->path, &status) == 0){
+    mode = status.st_mode & 07777;
+  }else{
+    mode_t mask = umask(0);
+    umask(mask);
+    mode = 0666 & ~mask;
+  }
+
+  struct stat saved;
+  bool done = fchmod(fd, mode) == 0
+           && writeRows(fd, &(editor->buffer))
+           && fsync(fd) == 0
+           && fstat(fd, &saved) == 0;
+  if(close(fd) != 0)
+    done = false;
+  //the mapping of the original file stays valid since its inode is only unlinked
+  if(done && rename(temporary, source->path) == 0){
+    char* slash = strrchr(source->path, '/');
+    int directory;
+    if(slash == NULL){
+      directory = open(".", O_RDONLY);
+    }else{
+      *slash = '\0';
+      directory = open(slash == source->path ? "/" : source->path, O_RDONLY);
+      *slash = '/';
+    }
+    if(directory != -1){
+      fsync(directory);
+      close(directory);
+    }
+    journalSave(&saved, editor);
+    setMessage("(saved)", statusPane);
+  }else{
+    setMessage(strerror(errno), statusPane);
+    unlink(temporary);
+    done = false;
+  }
+  free(temporary);
+  return done;
+}
+
+void resetScreen(){
+  Builder builder;
+  initBuilder(8, &builder);
+  appendLiteral("\x1b[2J", &builder); //clear screen
+  appendLiteral("\x1b[H", &builder); //move cursor to home (top-left)
+  flush(STDOUT_FILENO, &builder);
+  free(builder.raw);
+}
+
+void setBracketedPaste(bool isEnabled){
+  Builder builder;
+  initBuilder(8, &builder);
+  if(isEnabled)
+    appendLiteral("\x1b[?2004h", &builder);
+  else
+    appendLiteral("\x1b[?2004l", &builder);
+  flush(STDOUT_FILENO, &builder);
+  free(builder.raw);
+}
+
+//read as many bytes as available at once, and hand them out one by one
+int readByte(Input* input){
+  if(input->head == input->size){
+    ssize_t n;
+    do{
+      n = read(input->fd, input->raw, sizeof(input->raw));
+    }while(n == -1 && errno == EINTR);
+    if(n <= 0)
+      return EOF;
+    input->head = 0;
+    input->size = (int)n;
+  }
+  return (unsigned char)input->raw[input->head++];
+}
+
+bool hasPendingInput(Input* input){
+  if(input->head < input->size)
+    return true;
+  struct pollfd target = {input->fd, POLLIN, 0};
+  return poll(&target, 1, 0) == 1;
+}
+
+//(false: nothing in "milliseconds" (-1: no limit), or SIGWINCH came while waiting)
+bool waitForInput(Input* input, int milliseconds){
+  if(input->head < input->size)
+    return true;
+  fd_set targets;
+  FD_ZERO(&targets);
+  FD_SET(input->fd, &targets);
+  struct timespec timeout = {milliseconds / 1000, (milliseconds % 1000) * 1000000L};
+  return pselect(input->fd + 1, &targets, NULL, NULL, (milliseconds < 0) ? NULL : &timeout, &(input->waiting)) == 1;
+}
+
+//collect the bytes until ESC[201~ into Input.paste
+void readPaste(Input* input){
+  static const char END[] = "\x1b[201~";
+  const int n = sizeof(END) - 1;
+  Builder* paste = &(input->paste);
+  paste->size = 0;
+  int c;
+  while((c = readByte(input)) != EOF){
+    appendCharacter((char)c, paste);
+    if(n <= paste->size && memcmp(paste->raw + paste->size - n, END, n) == 0){
+      paste->size -= n;
+      break;
+    }
+  }
+}
+
+int readKey(Input* input){
+  enum{CTRL = 0x1f}; //(0001 1111)
+  int c = readByte(input);
+  switch(c){
+    case 8: //BS backspace or ctrl-h
+    case 127: //DEL
+      c = DELETE_LEFT;
+      break;
+
+    case (CTRL & 'd'): //ctrl-d
+      c = DELETE_RIGHT;
+      break;
+
+    case 9: //TAB, \t and ctrl-i
+      //(typed as it is, and drawn up to the next tab stop)
+      break;
+
+    case 10: //LF line feed, \n and ctrl-j
+    case 13: //CR carriage return, \r and ctrl-m
+      c = NEWLINE;
+      break;
+
+    case (CTRL & 'e'): //ctrl-e
+      c = RIGHTMOST;
+      break;
+
+    case (CTRL & 'a'): //ctrl-a
+      c = LEFTMOST;
+      break;
+
+    case (CTRL & 'f'): //ctrl-f
+      c = RIGHT;
+      break;
+
+    case (CTRL & 'b'): //ctrl-b
+      c = LEFT;
+      break;
+
+    case (CTRL & 'n'): //ctrl-n
+      c = DOWN;
+      break;
+
+    case (CTRL & 'p'): //ctrl-p
+      c = UP;
+      break;
+
+    case (CTRL & 'k'): //ctrl-k
+      c = DELETE_RIGHT_HALF;
+      break;
+
+    case (CTRL & 'v'): //ctrl-v
+      c = DOWNWARD;
+      break;
+
+    case '\x1b': //ESC
+      {
+        int c2 = readByte(input);
+        if(c2 == '['){
+          int c3 = readByte(input);
+          if('0' <= c3 && c3 <= '9'){ //ESC[<number>~
+            int number = 0;
+            while('0' <= c3 && c3 <= '9'){
+              number = number * 10 + (c3 - '0');
+              c3 = readByte(input);
+            }
+            if(number == 200 && c3 == '~'){ //beginning of a bracketed paste
+              readPaste(input);
+              c = PASTE_TEXT;
+            }
+          }else if(c3 == 'A')
+            c = UP;
+          else if(c3 == 'B')
+            c = DOWN;
+          else if(c3 == 'C')
+            c = RIGHT;
+          else if(c3 == 'D')
+            c = LEFT;
+        }else if(c2 == 'w'){ //alt-w
+          c = COPY_REGION;
+        }else if(c2 == 'v'){ //alt-v
+          c = UPWARD;
+        }else if(c2 == 'y'){ //alt-y
+          c = YANK_POP;
+        }else if(c2 == '_'){ //alt-_
+          c = REDO;
+        }else if(c2 == 's'){ //alt-s
+          c = FIND_ALL;
+        }else if(c2 == 'n'){ //alt-n
+          c = NEXT_HIT;
+        }else if(c2 == 'p'){ //alt-p
+          c = PREVIOUS_HIT;
+        }else if(c2 == '%'){ //alt-%
+          c = REPLACE_ALL;
+        }else if(c2 == 'l'){ //alt-l
+          c = SHOW_LATENCY;
+        }else if(c2 == 'g'){ //alt-g (prefix)
+          int c3 = readByte(input);
+          if(c3 == '\x1b') //(alt-g alt-...)
+            c3 = readByte(input);
+          if(c3 == 'g') //alt-g g
+            c = GOTO_LINE;
+          else if(c3 == 'c') //alt-g c
+            c = GOTO_BYTE;
+          else
+            c = CANCEL_COMMAND;
+        }
+      }
+      break;
+
+    case (CTRL & 'l'):
+      c = RECENTER;
+      break;
+
+    case (CTRL & 'g'): //ctrl-g
+      c = CANCEL_COMMAND;
+      break;
+
+    case (CTRL & ' '): //ctrl-space
+      c = ACTIVATE_REGION;
+      break;
+
+    case (CTRL & 'w'): //ctrl-w
+      c = CUT_REGION;
+      break;
+
+    case (CTRL & 'x'): //ctrl-x (prefix)
+      {
+        int c2 = readByte(input);
+        if(c2 == (CTRL & 's')) //ctrl-x ctrl-s
+          c = SAVE;
+        else if(c2 == 'u') //ctrl-x u
+          c = UNDO;
+        else
+          c = CANCEL_COMMAND;
+      }
+      break;
+
+    case (CTRL & 'y'): //ctrl-y
+      c = PASTE;
+      break;
+
+    case (CTRL & 's'): //ctrl-s
+      c = SEARCH_FORWARD;
+      break;
+
+    case (CTRL & 'r'): //ctrl-r
+      c = SEARCH_BACKWARD;
+      break;
+
+    case (CTRL & '_'): //ctrl-_ (and ctrl-/)
+      c = UNDO;
+      break;
+
+    case EOF:
+    case (CTRL & 'q'): //ctrl-q
+      c = QUIT;
+      break;
+
+    default:
+      break;
+  }
+//fprintf(stderr, "%x\n", c);
+  return c;
+}
+
+//a character of UTF-8 at "at" of a row, and how many bytes it takes
+//(an invalid byte is taken as a character by itself, whose codepoint is -1)
+int decodeCharacter(int at, Row* row, int* codepoint){
+  unsigned char lead = (unsigned char)getCharacter(at, row);
+  int length;
+  int minimum;
+  int value;
+  if(lead < 0x80){
+    *codepoint = lead;
+    return 1;
+  }else if((lead & 0xE0) == 0xC0){
+    length = 2;
+    minimum = 0x80;
+    value = lead & 0x1F;
+  }else if((lead & 0xF0) == 0xE0){
+    length = 3;
+    minimum = 0x800;
+    value = lead & 0x0F;
+  }else if((lead & 0xF8) == 0xF0){
+    length = 4;
+    minimum = 0x10000;
+    value = lead & 0x07;
+  }else{
+    *codepoint = -1;
+    return 1;
+  }
+
+  *codepoint = -1;
+  if(row->size - at < length)
+    return 1;
+  for(int i = 1; i < length; i++){
+    unsigned char next = (unsigned char)getCharacter(at + i, row);
+    if((next & 0xC0) != 0x80)
+      return 1;
+    value = (value << 6) | (next & 0x3F);
+  }
+  if(value < minimum || 0x10FFFF < value || (0xD800 <= value && value <= 0xDFFF)) //overlong or surrogate
+    return 1;
+  *codepoint = value;
+  return length;
+}
+
+//display columns of a character (an invalid byte or a control character is shown as a single "?")
+//ad-hoc: only the major ranges of combining (0) and East Asian wide (2) characters
+int measureCharacter(int codepoint){
+  static const int zeros[][2] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x0610, 0x061A}, {0x064B, 0x065F},
+    {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+    {0x200B, 0x200F}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}
+  };
+  static const int wides[][2] = {
+    {0x1100, 0x115F}, {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF},
+    {0xA000, 0xA4CF}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x1F300, 0x1F64F}, {0x1F900, 0x1F9FF}, {0x20000, 0x2FFFD},
+    {0x30000, 0x3FFFD}
+  };
+  if(codepoint < 0x0300)
+    return 1;
+  for(size_t i = 0; i < sizeof(zeros) / sizeof(zeros[0]); i++){
+    if(zeros[i][0] <= codepoint && codepoint <= zeros[i][1])
+      return 0;
+  }
+  for(size_t i = 0; i < sizeof(wides) / sizeof(wides[0]); i++){
+    if(wides[i][0] <= codepoint && codepoint <= wides[i][1])
+      return 2;
+  }
+  return 1;
+}
+
+bool isShown(int codepoint){
+  return 0x20 <= codepoint && codepoint != 0x7F && !(0x80 <= codepoint && codepoint < 0xA0);
+}
+
+//display columns of the character at "at", which begins at "column"
+int measureAt(int at, int column, Row* row, int tabWidth, int* length){
+  char c = getCharacter(at, row);
+  if(c == '\t'){
+    *length = 1;
+    return tabWidth - column % tabWidth;
+  }
+  int codepoint;
+  *length = decodeCharacter(at, row, &codepoint);
+  return measureCharacter(codepoint);
+}
+
+//take the breaks of a row again if its characters have changed since the last time
+//(a plain row of ASCII without tabs, found by SIMD, has no break at all)
+void takeBreaks(Row* row, int tabWidth){
+  if(row->measured == row->stamp)
+    return;
+  row->measured = row->stamp;
+  row->breakCount = 0;
+
+  Checker* checker = chooseChecker();
+  if(checker->isPlain(row->raw, row->gap) && checker->isPlain(row->raw + row->gap + (row->capacity - row->size), row->size - row->gap)){
+    row->width = row->size;
+    return;
+  }
+  int column = 0;
+  int at = 0;
+  while(at < row->size){
+    char c = getCharacter(at, row);
+    if((c & 0x80) == 0 && c != '\t'){
+      ++at;
+      ++column;
+      continue;
+    }
+    int length;
+    int width = measureAt(at, column, row, tabWidth, &length);
+    if(length != 1 || width != 1){
+      if(row->breakCount == row->breakCapacity){
+        row->breakCapacity = (row->breakCapacity == 0) ? 16 : row->breakCapacity * 2; //ad-hoc
+        Break* breaks = allocate(sizeof(Break) * row->breakCapacity, arenaOf(row));
+        if(0 < row->breakCount)
+          memcpy(breaks, row->breaks, sizeof(Break) * row->breakCount);
+        deallocate(row->breaks);
+        row->breaks = breaks;
+      }
+      Break* b = &(row->breaks[row->breakCount++]);
+      b->at = at;
+      b->column = column;
+      b->length = (unsigned char)length;
+      b->width = (unsigned char)width;
+    }
+    at += length;
+    column += width;
+  }
+  row->width = column;
+}
+
+//display column where the "at"-th byte is (the beginning of its character if it is in the middle of one)
+int columnAt(int at, Row* row, int tabWidth){
+  takeBreaks(row, tabWidth);
+  //the last break at or before "at"
+  int low = 0;
+  int high = row->breakCount;
+  while(low < high){
+    int middle = low + (high - low) / 2;
+    if(row->breaks[middle].at <= at)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  if(low == 0)
+    return at;
+  Break* b = &(row->breaks[low - 1]);
+  if(at < b->at + b->length)
+    return b->column;
+  return b->column + b->width + (at - (b->at + b->length));
+}
+
+//the first byte of the character shown at a display column (the end of the row if it is beyond)
+int byteAt(int column, Row* row, int tabWidth){
+  takeBreaks(row, tabWidth);
+  //the last break at or before "column"
+  int low = 0;
+  int high = row->breakCount;
+  while(low < high){
+    int middle = low + (high - low) / 2;
+    if(row->breaks[middle].column <= column)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  int at;
+  if(low == 0){
+    at = column;
+  }else{
+    Break* b = &(row->breaks[low - 1]);
+    if(column < b->column + b->width)
+      at = b->at;
+    else
+      at = b->at + b->length + (column - (b->column + b->width));
+  }
+  return (at < row->size) ? at : row->size;
+}
+
+//where the character after the one at "at" begins
+int nextCharacter(int at, Row* row){
+  int codepoint;
+  return at + decodeCharacter(at, row, &codepoint);
+}
+
+//where the character before "at" begins
+int previousCharacter(int at, Row* row){
+  if((getCharacter(at - 1, row) & 0xC0) == 0x80){ //a continuation byte
+    for(int begin = at - 2; at - 4 <= begin && 0 <= begin; begin--){
+      int codepoint;
+      if(decodeCharacter(begin, row, &codepoint) == at - begin)
+        return begin;
+      if((getCharacter(begin, row) & 0xC0) != 0x80)
+        break;
+    }
+  }
+  return at - 1;
+}
+
+//whether a key is a byte of text to be typed into a prompt or a query
+bool isText(int key){
+  return key == '\t' || (' ' <= key && key <= '~') || (0x80 <= key && key <= 0xFF);
+}
+
+//mark every line of the screen to be drawn again
+void invalidate(Window* window){
+  for(int i = 0; i < window->rows; i++)
+    window->lines[i].isValid = false;
+}
+
+void scroll(Editor* editor){
+  Cursor* cursor = &(editor->cursor);
+  Window* window = &(editor->window);
+  Scroll* scroll = &(window->scroll);
+
+  int verticalOffset = window->statusPane.rows;
+  if(cursor->row < scroll->row) //scroll upward
+    scroll->row = cursor->row;
+  else if((cursor->row + 1) > scroll->row + (window->rows - verticalOffset)) //scroll downward
+    scroll->row = (cursor->row + 1) - (window->rows - verticalOffset);
+
+  //(by display columns)
+  int horizontalOffset = window->lineNumnerPane.offset;
+  Row* row = getRow(cursor->row, &(editor->buffer));
+  int column = columnAt(cursor->column, row, window->tabWidth);
+  int next = (cursor->column < row->size) ? columnAt(nextCharacter(cursor->column, row), row, window->tabWidth) : column + 1; //(a wide character takes 2, and a tab up to the tab width)
+  if(next < column + 1)
+    next = column + 1;
+  if(column < scroll->column) //scroll left
+    scroll->column = column;
+  else if(next > scroll->column + (window->columns - horizontalOffset)) //scroll right
+    scroll->column = next - (window->columns - horizontalOffset);
+}
+
+//the display column of the cursor
+int getCursorColumn(Editor* editor){
+  return columnAt(editor->cursor.column, getRow(editor->cursor.row, &(editor->buffer)), editor->window.tabWidth);
+}
+
+void moveCursorUp(Editor* editor){
+  if(0 < editor->cursor.row){
+    int column = getCursorColumn(editor);
+    --editor->cursor.row;
+    int r = editor->cursor.row;
+    Row* row = getRow(r, &(editor->buffer));
+    editor->cursor.column = byteAt(column, row, editor->window.tabWidth);
+  }
+}
+
+void moveCursorDown(Editor* editor){
+  if(editor->cursor.row == editor->buffer.size - 1){
+    int r = editor->cursor.row;
+    Row* row = getRow(r, &(editor->buffer));
+    editor->cursor.column = row->size;
+  }else{
+    int column = getCursorColumn(editor);
+    ++editor->cursor.row;
+    int r = editor->cursor.row;
+    Row* row = getRow(r, &(editor->buffer));
+    editor->cursor.column = byteAt(column, row, editor->window.tabWidth);
+  }
+}
+
+void moveCursorDownward(Editor* editor){
+  int step = editor->window.rows - editor->window.statusPane.rows - 1;
+  int unseen = (editor->buffer.size - editor->window.scroll.row) - step;
+  if(0 < unseen){
+    if(unseen < step)
+      step = unseen;
+    for(int n = 0; n < step; n++){
+      moveCursorDown(editor);
+      ++(editor->window.scroll.row); //ad-hoc, ToDo: sync with cursor move
+    }
+  }
+}
+
+void moveCursorUpward(Editor* editor){
+  int step = editor->window.rows - editor->window.statusPane.rows - 1;
+  if(editor->window.scroll.row < step)
+    step = editor->window.scroll.row;
+  for(int n = 0; n < step; n++){
+    moveCursorUp(editor);
+    --(editor->window.scroll.row); //ad-hoc, ToDo: sync with cursor move
+  }
+}
+
+void recenterCursor(Editor* editor){
+  int middle = (editor->window.rows - editor->window.statusPane.rows) / 2;
+  int current = editor->cursor.row - editor->window.scroll.row;
+
+  int offset = current - middle;
+  if(editor->window.scroll.row + offset >= 0)
+    editor->window.scroll.row += offset;
+  else
+    editor->window.scroll.row = 0;
+}
+
+void moveCursorRight(Editor* editor){
   int c = editor->cursor.column;
   int r = editor->cursor.row;
-  Row* row = editor->buffer.rows[r];
+  Row* row = getRow(r, &(editor->buffer));
   if(c < row->size){
-    ++editor->cursor.column;
+    editor->cursor.column = nextCharacter(c, row);
   }else if(c == row->size && r < editor->buffer.size - 1){
     ++editor->cursor.row;
     editor->cursor.column = 0;
   }
 }
 
-void moveCursorLeft(Editor* editor){
-  int c = editor->cursor.column;
-  int r = editor->cursor.row;
-  if(0 < c){
-    --editor->cursor.column;
-  }else if(c == 0 && 0 < r){
-    --editor->cursor.row;
-    r = editor->cursor.row;
-    Row* row = editor->buffer.rows[r];
-    editor->cursor.column = row->size;
+void moveCursorLeft(Editor* editor){
+  int c = editor->cursor.column;
+  int r = editor->cursor.row;
+  if(0 < c){
+    editor->cursor.column = previousCharacter(c, getRow(r, &(editor->buffer)));
+  }else if(c == 0 && 0 < r){
+    --editor->cursor.row;
+    r = editor->cursor.row;
+    Row* row = getRow(r, &(editor->buffer));
+    editor->cursor.column = row->size;
+  }
+}
+
+void moveCursorToRightmost(Editor* editor){
+  int r = editor->cursor.row;
+  Row* row = getRow(r, &(editor->buffer));
+  editor->cursor.column = row->size;
+}
+
+void moveCursorToLeftmost(Editor* editor){
+  editor->cursor.column = 0;
+}
+
+//drop "count" rows from "at" without freeing them
+void dropRows(int at, int count, Buffer* buffer){
+  moveGap(at, buffer);
+  if(isBulk(count, buffer)){
+    flattenLengths(buffer);
+    for(int i = 0; i < count; i++)
+      buffer->lengths[locate(at + i, buffer) + 1] = 0;
+    buildLengths(buffer);
+  }else{
+    for(int i = 0; i < count; i++)
+      setLength(locate(at + i, buffer), 0, buffer);
+  }
+  buffer->size -= count; //the gap swallows the dropped slots
+  unsettle(at, buffer);
+}
+
+void removeRow(int at, Buffer* buffer){
+  if(0 <= at && at < buffer->size){
+    releaseRow(at, buffer);
+    dropRows(at, 1, buffer);
+  }
+}
+
+void extend(Row* row){
+  int capacity = fitCapacity(row->capacity * 2 + 1); //ad-hoc
+  Block* extended = createBlock(capacity, arenaOf(row));
+  int rest = row->size - row->gap;
+  memcpy(extended->raw, row->raw, row->gap);
+  memcpy(extended->raw + (capacity - rest), row->raw + (row->capacity - rest), rest);
+  if(row->block != NULL)
+    releaseBlock(row->block);
+  row->block = extended;
+  row->raw = extended->raw;
+  row->capacity = capacity;
+}
+
+void add(char character, Row* row, int at){
+  materialize(row);
+  if(row->size >= row->capacity)
+    extend(row);
+
+  shiftGap(at, row);
+  row->raw[row->gap] = character;
+  ++row->gap;
+  ++row->size;
+  touch(row);
+}
+
+//remove characters from "from" to "to" (exclusive)
+void removeCharacters(int from, int to, Row* row){
+  materialize(row);
+  shiftGap(to, row);
+  row->gap = from;
+  row->size -= (to - from);
+  touch(row);
+}
+
+void shorten(int at, Row* row){
+  if(at < row->gap){
+    row->gap = at;
+  }else{
+    materialize(row);
+    shiftGap(at, row);
+  }
+  row->size = at;
+  touch(row);
+}
+
+void expand(Buffer* buffer){
+  int capacity = buffer->capacity * 2; //ad-hoc
+  if(capacity == 0)
+    capacity = 16; //ad-hoc
+  Row** expanded = malloc(sizeof(Row*) * capacity);
+  int rest = buffer->size - buffer->gap;
+  memcpy(expanded, buffer->rows, sizeof(Row*) * buffer->gap);
+  memcpy(expanded + (capacity - rest), buffer->rows + (buffer->capacity - rest), sizeof(Row*) * rest);
+  free(buffer->rows);
+  buffer->rows = expanded;
+  buffer->states = realloc(buffer->states, sizeof(unsigned char) * capacity); //(by row number, so the settled ones stay where they are)
+
+  //the lengths are rebuilt in the same layout (lengths[i + 1] is of the i-th slot)
+  flattenLengths(buffer);
+  size_t* lengths = calloc(capacity + 1, sizeof(size_t));
+  memcpy(lengths + 1, buffer->lengths + 1, sizeof(size_t) * buffer->gap);
+  memcpy(lengths + 1 + (capacity - rest), buffer->lengths + 1 + (buffer->capacity - rest), sizeof(size_t) * rest);
+  free(buffer->lengths);
+  buffer->lengths = lengths;
+  buffer->capacity = capacity;
+  buildLengths(buffer);
+}
+
+//insert "count" rows at "at" with a single move of the gap
+void splice(Row** rows, int count, Buffer* buffer, int at){
+  while(buffer->capacity - buffer->size < count)
+    expand(buffer);
+
+  moveGap(at, buffer);
+  memcpy(buffer->rows + at, rows, sizeof(Row*) * count);
+  buffer->gap += count;
+  buffer->size += count;
+  if(isBulk(count, buffer)){
+    flattenLengths(buffer);
+    for(int i = 0; i < count; i++)
+      buffer->lengths[at + i + 1] = rows[i]->size + 1;
+    buildLengths(buffer);
+  }else{
+    for(int i = 0; i < count; i++)
+      indexRow(at + i, buffer);
+  }
+  unsettle(at, buffer);
+}
+
+void inject(Row* row, Buffer* buffer, int at){
+  splice(&row, 1, buffer, at);
+}
+
+Row* partition(Row* row, int pivot){
+  Row* second = createEmptyRow(row->size - pivot, arenaOf(row));
+  int size = row->size - pivot;
+  copyCharacters(row, pivot, row->size, second->raw);
+  second->size = size;
+  second->gap = size;
+  shorten(pivot, row);
+  return second;
+}
+
+void insert(int key, Editor* editor){
+  int r = editor->cursor.row;
+  Row* row = editRow(r, &(editor->buffer));
+  if(!row->isEnabled)
+    row->isEnabled = true;
+  if(key == NEWLINE){
+    Row* second = partition(row, editor->cursor.column);
+    if(0 < second->size || r < editor->buffer.size - 1)
+      second->isEnabled = true;
+    indexRow(r, &(editor->buffer));
+    inject(second, &(editor->buffer), editor->cursor.row + 1);
+
+    //move cursor to the beginning of the injected row
+    ++editor->cursor.row;
+    editor->cursor.column = 0;
+
+    setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
+  }else{
+    add((char)key, row, editor->cursor.column);
+    indexRow(r, &(editor->buffer));
+
+    //(a byte of a utf-8 sequence, so not moveCursorRight())
+    ++editor->cursor.column;
+  }
+}
+
+void append(Row* one, Row* to){
+  materialize(to);
+  while((to->size + one->size) > to->capacity){
+    extend(to);
+  }
+  shiftGap(to->size, to);
+  copyCharacters(one, 0, one->size, to->raw + to->size);
+  to->size += one->size;
+  to->gap = to->size;
+  touch(to);
+}
+
+void deleteLeftCharacter(Editor* editor){
+  int r = editor->cursor.row;
+  int c = editor->cursor.column;
+  Row* row = editRow(r, &(editor->buffer));
+  if(c == 0){
+    if(r != 0){
+      Row* previous = editRow(r - 1, &(editor->buffer));
+      int pin = previous->size;
+      append(row, previous);
+      removeRow(r, &(editor->buffer));
+      indexRow(r - 1, &(editor->buffer));
+
+      //"previouse" became the last row and is empty
+      if(r - 1 == editor->buffer.size - 1 && previous->size == 0)
+        previous->isEnabled = false;
+
+      //move cursor to the pinned location
+      --editor->cursor.row;
+      editor->cursor.column = pin;
+
+      setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
+    }
+  }else{
+    int left = previousCharacter(c, row);
+    removeCharacters(left, c, row);
+    indexRow(r, &(editor->buffer));
+
+    editor->cursor.column = left;
+  }
+}
+
+void deleteRightCharacter(Editor* editor){
+  int r = editor->cursor.row;
+  int c = editor->cursor.column;
+  Row* row = editRow(r, &(editor->buffer));
+  if(c == row->size){
+    if(r != editor->buffer.size - 1){
+      Row* next = getRow(r + 1, &(editor->buffer));
+      append(next, row);
+      removeRow(r + 1, &(editor->buffer));
+
+      setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
+    }
+  }else{
+    removeCharacters(c, nextCharacter(c, row), row);
+  }
+  indexRow(r, &(editor->buffer));
+  //"row" is the last row and is empty
+  if(r == editor->buffer.size - 1 && row->size == 0)
+    row->isEnabled = false;
+}
+
+void deleteRightHalf(Editor* editor){
+  int r = editor->cursor.row;
+  int c = editor->cursor.column;
+  Row* row = editRow(r, &(editor->buffer));
+  if(c == row->size){
+    if(r != editor->buffer.size - 1){
+      Row* next = getRow(r + 1, &(editor->buffer));
+      append(next, row);
+      removeRow(r + 1, &(editor->buffer));
+
+      setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
+    }
+  }else{
+    shorten(c, row);
+  }
+  indexRow(r, &(editor->buffer));
+  //"row" is the last row and is empty
+  if(r == editor->buffer.size - 1 && row->size == 0)
+    row->isEnabled = false;
+}
+
+//give a clip a copy of the characters it looks into, as a small row changes them in place and takes them along when freed
+void detachClip(Clip* clip, Arena* arena){
+  View view = clip->view;
+  clip->block = createBlock(view.frontSize + view.backSize, arena);
+  if(0 < view.frontSize)
+    memcpy(clip->block->raw, view.front, view.frontSize);
+  if(0 < view.backSize)
+    memcpy(clip->block->raw + view.frontSize, view.back, view.backSize);
+  clip->view.front = clip->block->raw;
+  clip->view.frontSize = view.frontSize + view.backSize;
+  clip->view.back = NULL;
+  clip->view.backSize = 0;
+}
+
+//put the region on the kill ring without copying the characters (but those of small rows)
+void copyRegion(Editor* editor){
+  Buffer* buffer = &(editor->buffer);
+  Region* region = &(buffer->region);
+  Clipboard* clipboard = &(editor->clipboard);
+  if(region->isActive){
+    Clip* head = NULL;
+    Clip* current = NULL;
+    size_t size = 0;
+    Point* from = region->head;
+    Point* to = region->tail;
+    for(int r = from->row; r <= to->row; r++){
+      View view = viewRow(r, buffer);
+      int start = (r == from->row) ? from->column : 0;
+      int end = (r == to->row) ? to->column : view.frontSize + view.backSize;
+      Clip* clip = malloc(sizeof(Clip));
+      clip->block = getBlock(r, buffer);
+      if(clip->block != NULL)
+        retainBlock(clip->block);
+      clip->view = sliceView(view, start, end);
+      if(isSmall(r, buffer))
+        detachClip(clip, &(buffer->arena));
+      clip->next = NULL;
+      if(current == NULL)
+        head = clip;
+      else
+        current->next = clip;
+      current = clip;
+      size += (end - start) + (r < to->row ? 1 : 0);
+    }
+    keepKill(head, size, clipboard);
+  }
+}
+
+void deleteRegion(Editor* editor){
+  Buffer* buffer = &(editor->buffer);
+  Region* region = &(buffer->region);
+  Cursor* cursor = &(editor->cursor);
+
+  if(region->isActive){
+    Point* head = region->head;
+    Point* tail = region->tail;
+    if(head->row == tail->row){
+      if(head->column != tail->column){
+        Row* row = editRow(head->row, buffer);
+        removeCharacters(head->column, tail->column, row);
+        indexRow(head->row, buffer);
+      }
+    }else{
+      Row* first = getRow(head->row, buffer);
+      Row* last = getRow(tail->row, buffer);
+      Row* row = createEmptyRow(head->column + (last->size - tail->column), &(buffer->arena));
+      copyCharacters(first, 0, head->column, row->raw);
+      copyCharacters(last, tail->column, last->size, row->raw + head->column);
+      row->size = head->column + (last->size - tail->column);
+      row->gap = row->size;
+      row->isEnabled = true;
+
+      for(int i = head->row; i <= tail->row; i++){
+        releaseRow(i, buffer);
+      }
+      setRow(row, head->row, buffer);
+      indexRow(head->row, buffer);
+      dropRows(head->row + 1, tail->row - head->row, buffer);
+    }
+    //move cursor to the begining of the region
+    cursor->row = head->row;
+    cursor->column = head->column;
+  }
+}
+
+void appendView(View* view, Row* to){
+  materialize(to);
+  while((to->size + view->frontSize + view->backSize) > to->capacity){
+    extend(to);
+  }
+  shiftGap(to->size, to);
+  if(0 < view->frontSize)
+    memcpy(to->raw + to->size, view->front, view->frontSize);
+  if(0 < view->backSize)
+    memcpy(to->raw + to->size + view->frontSize, view->back, view->backSize);
+  to->size += view->frontSize + view->backSize;
+  to->gap = to->size;
+  touch(to);
+}
+
+//insert lines at the cursor, all the new rows at once
+//(the first line continues the current row and the last one is followed by the rest of it)
+void insertLines(View* lines, int count, Editor* editor){
+  Buffer* buffer = &(editor->buffer);
+  int r = editor->cursor.row;
+  int c = editor->cursor.column;
+  bool isLastRow = (r == buffer->size - 1);
+  Row* row = editRow(r, buffer);
+  Row* second = partition(row, c);
+
+  appendView(&(lines[0]), row);
+  if(0 < lines[0].frontSize + lines[0].backSize || 1 < count)
+    row->isEnabled = true;
+  Row* last = row;
+  int column = c + lines[0].frontSize + lines[0].backSize;
+
+  if(1 < count){
+    Row** rows = malloc(sizeof(Row*) * (count - 1));
+    for(int i = 1; i < count; i++){
+      Row* copy = createEmptyRow(lines[i].frontSize + lines[i].backSize, &(buffer->arena));
+      appendView(&(lines[i]), copy);
+      copy->isEnabled = (i < count - 1 || 0 < copy->size || !isLastRow);
+      rows[i - 1] = copy;
+    }
+    splice(rows, count - 1, buffer, r + 1);
+    last = rows[count - 2];
+    column = last->size;
+    free(rows);
+
+    setLineNumberOffsetBy(buffer->size, &(editor->window.lineNumnerPane));
+  }
+  append(second, last);
+  destroyRow(second);
+  if(1 < count)
+    last->isEnabled = (0 < last->size || !isLastRow); //(as in insert(), now that the rest of the split row is in it)
+  indexRow(r, buffer);
+  indexRow(r + (count - 1), buffer);
+
+  editor->cursor.row = r + (count - 1);
+  editor->cursor.column = column;
+}
+
+//(text: CR and CRLF are taken as newlines as well as LF)
+void insertText(char* text, int length, Editor* editor){
+  int count = 1;
+  for(int i = 0; i < length; i++){
+    if(text[i] == '\n' || (text[i] == '\r' && (i + 1 == length || text[i + 1] != '\n')))
+      ++count;
+  }
+
+  View* lines = malloc(sizeof(View) * count);
+  int l = 0;
+  int begin = 0;
+  for(int i = 0; i <= length; i++){
+    if(i == length || text[i] == '\n' || text[i] == '\r'){
+      lines[l].front = text + begin;
+      lines[l].frontSize = i - begin;
+      lines[l].back = NULL;
+      lines[l].backSize = 0;
+      ++l;
+      if(i + 1 < length && text[i] == '\r' && text[i + 1] == '\n')
+        ++i;
+      begin = i + 1;
+    }
+  }
+  insertLines(lines, count, editor);
+  free(lines);
+}
+
+void pasteKill(Kill* kill, Editor* editor){
+  int count = 0;
+  for(Clip* clip = kill->head; clip != NULL; clip = clip->next)
+    ++count;
+
+  View* lines = malloc(sizeof(View) * count);
+  int l = 0;
+  for(Clip* clip = kill->head; clip != NULL; clip = clip->next)
+    lines[l++] = clip->view;
+  insertLines(lines, count, editor);
+  free(lines);
+}
+
+//paste the most recent kill
+void pasteFromClipboard(Editor* editor){
+  Clipboard* clipboard = &(editor->clipboard);
+  if(0 < clipboard->count){
+    clipboard->yankFrom.row = editor->cursor.row;
+    clipboard->yankFrom.column = editor->cursor.column;
+    pasteKill(&(clipboard->kills[clipboard->latest]), editor);
+    clipboard->yank = clipboard->latest;
+    clipboard->yankTo.row = editor->cursor.row;
+    clipboard->yankTo.column = editor->cursor.column;
+  }
+}
+
+//replace the text pasted by the last command with the kill before it (the oldest one is followed by the most recent one)
+void pastePreviousKill(Editor* editor){
+  Clipboard* clipboard = &(editor->clipboard);
+  Region* region = &(editor->buffer.region);
+  mark(region, clipboard->yankFrom.row, clipboard->yankFrom.column);
+  point(region, clipboard->yankTo.row, clipboard->yankTo.column);
+  deleteRegion(editor);
+  deactivateRegion(editor);
+
+  int oldest = (clipboard->latest - (clipboard->count - 1) + KILL_RING_CAPACITY) % KILL_RING_CAPACITY;
+  if(clipboard->yank == oldest)
+    clipboard->yank = clipboard->latest;
+  else
+    clipboard->yank = (clipboard->yank - 1 + KILL_RING_CAPACITY) % KILL_RING_CAPACITY;
+  pasteKill(&(clipboard->kills[clipboard->yank]), editor);
+  clipboard->yankTo.row = editor->cursor.row;
+  clipboard->yankTo.column = editor->cursor.column;
+}
+
+Point here(Editor* editor){
+  Point point = {editor->cursor.row, editor->cursor.column};
+  return point;
+}
+
+int measureRow(int at, Buffer* buffer){
+  View view = viewRow(at, buffer);
+  return view.frontSize + view.backSize;
+}
+
+//the point before the character left of the cursor (a newline at the beginning of a row)
+Point leftOf(Editor* editor){
+  Point point = here(editor);
+  if(0 < point.column){
+    point.column = previousCharacter(point.column, getRow(point.row, &(editor->buffer)));
+  }else if(0 < point.row){
+    --point.row;
+    point.column = measureRow(point.row, &(editor->buffer));
+  }
+  return point;
+}
+
+//the point after the character right of the cursor, or after the rest of the row ("isHalf")
+Point rightOf(bool isHalf, Editor* editor){
+  Buffer* buffer = &(editor->buffer);
+  Point point = here(editor);
+  int size = measureRow(point.row, buffer);
+  if(point.column < size){
+    point.column = isHalf ? size : nextCharacter(point.column, getRow(point.row, buffer));
+  }else if(point.row < buffer->size - 1){
+    ++point.row;
+    point.column = 0;
   }
+  return point;
 }
 
-void moveCursorToRightmost(Editor* editor){
-  int r = editor->cursor.row;
-  Row* row = editor->buffer.rows[r];
-  editor->cursor.column = row->size;
+bool isSamePoint(Point a, Point b){
+  return a.row == b.row && a.column == b.column;
 }
 
-void moveCursorToLeftmost(Editor* editor){
-  editor->cursor.column = 0;
+//where a text put at "from" ends
+Point advance(Point from, const char* text, size_t length){
+  Point to = from;
+  for(size_t i = 0; i < length; i++){
+    if(text[i] == '\n'){
+      ++to.row;
+      to.column = 0;
+    }else{
+      ++to.column;
+    }
+  }
+  return to;
 }
 
-void removeRow(int at, Buffer* buffer){
-  if(0 <= at && at < buffer->size){
-    Row* row = buffer->rows[at];
-    for(int i = at; i < buffer->size - 1; i++)
-      buffer->rows[i] = buffer->rows[i + 1];
-    --buffer->size;
-    free(row->raw);
-    free(row);
+//copy the text from "from" to "to" (exclusive) with newlines between the rows, and return its length
+//(destination: NULL to measure the length only)
+size_t takeText(Point from, Point to, Buffer* buffer, char* destination){
+  size_t n = 0;
+  for(int r = from.row; r <= to.row; r++){
+    View view = viewRow(r, buffer);
+    int start = (r == from.row) ? from.column : 0;
+    int end = (r == to.row) ? to.column : view.frontSize + view.backSize;
+    if(destination != NULL){
+      View slice = sliceView(view, start, end);
+      if(0 < slice.frontSize)
+        memcpy(destination + n, slice.front, slice.frontSize);
+      if(0 < slice.backSize)
+        memcpy(destination + n + slice.frontSize, slice.back, slice.backSize);
+    }
+    n += end - start;
+    if(r < to.row){
+      if(destination != NULL)
+        destination[n] = '\n';
+      ++n;
+    }
   }
+  return n;
 }
 
-void extend(Row* row){
-  row->capacity *= 2; //ad-hoc
-  char* extended = malloc(sizeof(char) * row->capacity);
-  for(int i = 0; i < row->size; i++)
-    extended[i] = row->raw[i];
-  free(row->raw);
-  row->raw = extended;
+void keepText(Record* record, History* history, Buffer* buffer){
+  size_t length = takeText(record->from, record->to, buffer, NULL);
+  char* text = reserveText(length, record, history);
+  takeText(record->from, record->to, buffer, text);
 }
 
-void add(char character, Row* row, int at){
-  if(row->size >= row->capacity)
-    extend(row);
+void deleteText(Point from, Point to, Editor* editor){
+  Region* region = &(editor->buffer.region);
+  mark(region, from.row, from.column);
+  point(region, to.row, to.column);
+  deleteRegion(editor);
+  deactivateRegion(editor);
+}
 
-  for(int i = row->size; i > at; i--)
-    row->raw[i] = row->raw[i - 1];
-  row->raw[at] = character;
-  ++row->size;
+//insert a text at the cursor (only LF is taken as a newline)
+void restoreText(char* text, size_t length, Editor* editor){
+  int count = 1;
+  for(size_t i = 0; i < length; i++){
+    if(text[i] == '\n')
+      ++count;
+  }
+
+  View* lines = malloc(sizeof(View) * count);
+  int l = 0;
+  size_t begin = 0;
+  for(size_t i = 0; i <= length; i++){
+    if(i == length || text[i] == '\n'){
+      lines[l].front = text + begin;
+      lines[l].frontSize = i - begin;
+      lines[l].back = NULL;
+      lines[l].backSize = 0;
+      ++l;
+      begin = i + 1;
+    }
+  }
+  insertLines(lines, count, editor);
+  free(lines);
 }
 
-void expand(Buffer* buffer){
-  buffer->capacity *= 2; //ad-hoc
-  Row** expanded = malloc(sizeof(Row*) * buffer->capacity);
-  for(int i = 0; i < buffer->size; i++)
-    expanded[i] = buffer->rows[i];
-  free(buffer->rows);
-  buffer->rows = expanded;
+Record* addRecord(History* history){
+  if(history->count == history->capacity){
+    if(history->capacity / 2 <= history->first){
+      memmove(history->records, history->records + history->first, sizeof(Record) * (history->count - history->first));
+      history->count -= history->first;
+      history->done -= history->first;
+      history->latest -= history->first;
+      history->first = 0;
+    }else{
+      history->capacity *= 2; //ad-hoc
+      history->records = realloc(history->records, sizeof(Record) * history->capacity);
+    }
+  }
+  Record* record = &(history->records[history->count++]);
+  history->done = history->count;
+  history->size += sizeof(Record);
+  record->chunk = NULL;
+  record->offset = 0;
+  record->length = 0;
+  return record;
 }
 
-void inject(Row* row, Buffer* buffer, int at){
-  if(buffer->size >= buffer->capacity)
-    expand(buffer);
+Record* getLastRecord(History* history){
+  if(history->first < history->count)
+    return &(history->records[history->count - 1]);
+  else
+    return NULL;
+}
 
-  for(int i = buffer->size; i > at; i--)
-    buffer->rows[i] = buffer->rows[i - 1];
-  buffer->rows[at] = row;
-  ++buffer->size;
+//(after the text from "from" to "to" has been inserted)
+void journalInsertion(Point from, Point to, Editor* editor){
+  Journal* journal = &(editor->journal);
+  if(!journal->isEnabled)
+    return;
+  Buffer* buffer = &(editor->buffer);
+  Entry* entry = createEntry(takeText(from, to, buffer, NULL));
+  entry->change = INSERTION;
+  entry->from = from;
+  entry->to = to;
+  takeText(from, to, buffer, entry->text);
+  putEntry(entry, journal);
 }
 
-Row* partition(Row* row, int pivot){
-  Row* second = createEmptyRow(row->capacity);
-  int size = row->size - pivot;
-  for(int i = 0; i < size; i++){
-    second->raw[i] = row->raw[pivot + i];
-    ++second->size;
+//(before the text from "from" to "to" is deleted)
+void journalDeletion(Point from, Point to, Editor* editor){
+  Journal* journal = &(editor->journal);
+  if(!journal->isEnabled)
+    return;
+  Entry* entry = createEntry(0);
+  entry->change = DELETION;
+  entry->from = from;
+  entry->to = to;
+  putEntry(entry, journal);
+}
+
+//(after the text from "from" to "to" has been inserted)
+bool recordInsertion(Point from, Point to, bool isTyping, bool isChained, Editor* editor){
+  History* history = &(editor->history);
+  if(isSamePoint(from, to))
+    return false;
+  journalInsertion(from, to, editor);
+
+  forgetRedo(history);
+  Record* last = getLastRecord(history);
+  if(isTyping && !isChained && last != NULL
+      && last->change == INSERTION && last->isTyping && last->chunk == NULL
+      && isSamePoint(last->to, from) && last->to.column - last->from.column < 20){ //ad-hoc
+    last->to = to;
+  }else{
+    Record* record = addRecord(history);
+    record->change = INSERTION;
+    record->from = from;
+    record->to = to;
+    record->isTyping = isTyping;
+    record->isChained = isChained;
+    if(!isChained)
+      history->latest = history->count - 1;
   }
-  row->size = pivot;
-  return second;
+  trimHistory(history);
+  return true;
 }
 
-void insert(int key, Editor* editor){
-  int r = editor->cursor.row;
-  Row* row = editor->buffer.rows[r];
-  if(!row->isEnabled)
-    row->isEnabled = true;
-  if(key == NEWLINE){
-    Row* second = partition(row, editor->cursor.column);
-    if(0 < second->size || r < editor->buffer.size - 1)
-      second->isEnabled = true;
-    inject(second, &(editor->buffer), editor->cursor.row + 1);
+//(before the text from "from" to "to" is deleted)
+bool recordDeletion(Point from, Point to, bool isTyping, bool isChained, Editor* editor){
+  History* history = &(editor->history);
+  Buffer* buffer = &(editor->buffer);
+  if(isSamePoint(from, to))
+    return false;
+  journalDeletion(from, to, editor);
+
+  forgetRedo(history);
+  Record* last = getLastRecord(history);
+  Chunk* chunk = history->chunk;
+  size_t length = isTyping ? takeText(from, to, buffer, NULL) : 0; //a typed deletion is a character (up to 4 bytes of utf-8)
+  if(isTyping && !isChained && last != NULL
+      && last->change == DELETION && last->isTyping && last->length < 20 //ad-hoc
+      && last->chunk == chunk && last->offset + last->length == chunk->size && chunk->size + length <= chunk->capacity
+      && (isSamePoint(from, last->from) || isSamePoint(to, last->from))){
+    //the text of the last record is at the end of the chunk, so it can grow in place
+    char* text = chunk->raw + last->offset;
+    if(isSamePoint(from, last->from)){ //deleted forward
+      takeText(from, to, buffer, text + last->length);
+    }else{ //deleted backward
+      memmove(text + length, text, last->length);
+      takeText(from, to, buffer, text);
+      last->from = from;
+    }
+    last->length += length;
+    chunk->size += length;
+    history->size += length;
+    last->to = advance(last->from, text, last->length);
+  }else{
+    Record* record = addRecord(history);
+    record->change = DELETION;
+    record->from = from;
+    record->to = to;
+    record->isTyping = isTyping;
+    record->isChained = isChained;
+    if(!isChained)
+      history->latest = history->count - 1;
+    keepText(record, history, buffer);
+  }
+  trimHistory(history);
+  return true;
+}
 
-    //move cursor to the beginning of the injected row
-    ++editor->cursor.row;
-    editor->cursor.column = 0;
+//the last row is shown as empty once it has no characters
+void settleLastRow(Buffer* buffer){
+  Row* last = getRow(buffer->size - 1, buffer);
+  if(last->size == 0)
+    last->isEnabled = false;
+}
 
-    setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
+bool undo(Editor* editor){
+  History* history = &(editor->history);
+  Buffer* buffer = &(editor->buffer);
+  if(history->done <= history->first)
+    return false;
+
+  deactivateRegion(editor);
+  bool isChained = true;
+  while(isChained && history->first < history->done){
+    Record* record = &(history->records[--history->done]);
+    if(record->change == INSERTION){
+      if(record->chunk == NULL)
+        keepText(record, history, buffer);
+      journalDeletion(record->from, record->to, editor);
+      deleteText(record->from, record->to, editor);
+    }else{
+      editor->cursor.row = record->from.row;
+      editor->cursor.column = record->from.column;
+      restoreText(record->chunk->raw + record->offset, record->length, editor);
+      journalInsertion(record->from, record->to, editor);
+    }
+    isChained = record->isChained;
+  }
+  history->latest = history->done - 1;
+  while(history->first < history->latest && history->records[history->latest].isChained)
+    --history->latest;
+  if(history->latest < history->first)
+    history->latest = history->first;
+  settleLastRow(buffer);
+  setLineNumberOffsetBy(buffer->size, &(editor->window.lineNumnerPane));
+  trimHistory(history);
+  return true;
+}
+
+bool redo(Editor* editor){
+  History* history = &(editor->history);
+  Buffer* buffer = &(editor->buffer);
+  if(history->count <= history->done)
+    return false;
+
+  deactivateRegion(editor);
+  history->latest = history->done;
+  do{
+    Record* record = &(history->records[history->done++]);
+    if(record->change == INSERTION){
+      editor->cursor.row = record->from.row;
+      editor->cursor.column = record->from.column;
+      restoreText(record->chunk->raw + record->offset, record->length, editor);
+      journalInsertion(record->from, record->to, editor);
+    }else{
+      journalDeletion(record->from, record->to, editor);
+      deleteText(record->from, record->to, editor);
+    }
+  }while(history->done < history->count && history->records[history->done].isChained);
+  settleLastRow(buffer);
+  setLineNumberOffsetBy(buffer->size, &(editor->window.lineNumnerPane));
+  return true;
+}
+
+//where "needle" begins first at or after "from" on the "at"-th row (-1: nowhere)
+int findInRow(int at, int from, const char* needle, int size, Buffer* buffer){
+  Finder* finder = chooseFinder();
+  View view = viewRow(at, buffer);
+  if(from < view.frontSize){
+    int found = finder->find(view.front + from, view.frontSize - from, needle, size);
+    if(found != -1)
+      return from + found;
+
+    //across the gap
+    int begin = view.frontSize - (size - 1);
+    if(begin < from)
+      begin = from;
+    for(int c = begin; c < view.frontSize && c + size <= view.frontSize + view.backSize; c++){
+      int n = view.frontSize - c;
+      if(memcmp(view.front + c, needle, n) == 0 && memcmp(view.back, needle + n, size - n) == 0)
+        return c;
+    }
+  }
+  int begin = (from < view.frontSize) ? 0 : from - view.frontSize;
+  if(begin < view.backSize){
+    int found = finder->find(view.back + begin, view.backSize - begin, needle, size);
+    if(found != -1)
+      return view.frontSize + begin + found;
+  }
+  return -1;
+}
+
+//where "needle" begins last at or before "to" on the "at"-th row (-1: nowhere)
+int findLastInRow(int at, int to, const char* needle, int size, Buffer* buffer){
+  int last = -1;
+  int found = findInRow(at, 0, needle, size, buffer);
+  while(found != -1 && found <= to){
+    last = found;
+    found = findInRow(at, found + 1, needle, size, buffer);
+  }
+  return last;
+}
+
+bool findForward(Point from, const char* needle, int size, Buffer* buffer, Point* found){
+  for(int r = from.row; r < buffer->size; r++){
+    int c = findInRow(r, (r == from.row) ? from.column : 0, needle, size, buffer);
+    if(c != -1){
+      found->row = r;
+      found->column = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool findBackward(Point from, const char* needle, int size, Buffer* buffer, Point* found){
+  for(int r = from.row; 0 <= r; r--){
+    int to = (r == from.row) ? from.column : INT_MAX;
+    int c = (0 <= to) ? findLastInRow(r, to, needle, size, buffer) : -1;
+    if(c != -1){
+      found->row = r;
+      found->column = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+void showSearch(Editor* editor){
+  Search* search = &(editor->search);
+  Builder message;
+  initBuilder(64, &message); //ad-hoc
+  if(!search->isFound)
+    appendLiteral("Failing ", &message);
+  appendLiteral("I-search", &message);
+  if(search->isBackward)
+    appendLiteral(" backward", &message);
+  appendLiteral(": ", &message);
+  appendBytes(search->query.raw, search->query.size, &message);
+  appendCharacter('\0', &message);
+  setMessage(message.raw, &(editor->window.statusPane));
+  free(message.raw);
+}
+
+void beginSearch(bool isBackward, Editor* editor){
+  Search* search = &(editor->search);
+  search->isActive = true;
+  search->isBackward = isBackward;
+  search->isFound = true;
+  search->query.size = 0;
+  search->origin = here(editor);
+  search->match = search->origin;
+  showSearch(editor);
+}
+
+//look for the query from "from" (a match may begin there) and put the cursor on the match
+void seek(Point from, Editor* editor){
+  Search* search = &(editor->search);
+  Builder* query = &(search->query);
+  Point found;
+  if(search->isBackward)
+    search->isFound = findBackward(from, query->raw, query->size, &(editor->buffer), &found);
+  else
+    search->isFound = findForward(from, query->raw, query->size, &(editor->buffer), &found);
+  if(search->isFound){
+    search->match = found;
+    editor->cursor.row = found.row;
+    editor->cursor.column = search->isBackward ? found.column : found.column + query->size;
+  }
+}
+
+void endSearch(Editor* editor){
+  Search* search = &(editor->search);
+  if(0 < search->query.size){
+    search->last.size = 0;
+    appendBytes(search->query.raw, search->query.size, &(search->last));
+  }
+  search->isActive = false;
+  pointRegion(editor);
+}
+
+//(it returns false when the key ends the search and is to be handled as usual)
+bool continueSearch(int key, Editor* editor){
+  Search* search = &(editor->search);
+  Builder* query = &(search->query);
+  switch(key){
+    case SEARCH_FORWARD:
+    case SEARCH_BACKWARD:
+      search->isBackward = (key == SEARCH_BACKWARD);
+      if(query->size == 0){
+        if(0 < search->last.size){ //search the previous query again
+          appendBytes(search->last.raw, search->last.size, query);
+          seek(search->match, editor);
+        }
+      }else if(!search->isFound){ //wrap around
+        Point from = {0, 0};
+        if(search->isBackward){
+          from.row = editor->buffer.size - 1;
+          from.column = INT_MAX;
+        }
+        seek(from, editor);
+      }else{ //next match
+        Point from = search->match;
+        from.column += search->isBackward ? -1 : 1;
+        seek(from, editor);
+      }
+      break;
+
+    case DELETE_LEFT:
+      if(0 < query->size){
+        --query->size;
+        if(query->size == 0){
+          search->isFound = true;
+          search->match = search->origin;
+          editor->cursor.row = search->origin.row;
+          editor->cursor.column = search->origin.column;
+        }else{
+          seek(search->origin, editor);
+        }
+      }
+      break;
+
+    case NEWLINE:
+      endSearch(editor);
+      clearMessage(&(editor->window.statusPane));
+      return true;
+
+    case CANCEL_COMMAND:
+      editor->cursor.row = search->origin.row;
+      editor->cursor.column = search->origin.column;
+      endSearch(editor);
+      setMessage("(quit search)", &(editor->window.statusPane)); //ad-hoc for demo
+      return true;
+
+    default:
+      if(isText(key)){
+        appendCharacter((char)key, query);
+        //the longer query can only match from the current match on
+        if(search->isFound)
+          seek(search->match, editor);
+      }else{
+        endSearch(editor);
+        return false;
+      }
+      break;
+  }
+  showSearch(editor);
+  return true;
+}
+
+void showPrompt(Editor* editor){
+  Prompt* prompt = &(editor->prompt);
+  Builder message;
+  initBuilder(64, &message); //ad-hoc
+  appendString(prompt->label, &message);
+  appendBytes(prompt->text.raw, prompt->text.size, &message);
+  appendCharacter('\0', &message);
+  setMessage(message.raw, &(editor->window.statusPane));
+  free(message.raw);
+}
+
+void beginPrompt(char* label, void (*answer)(Editor* editor), Editor* editor){
+  Prompt* prompt = &(editor->prompt);
+  prompt->isActive = true;
+  prompt->label = label;
+  prompt->text.size = 0;
+  prompt->answer = answer;
+  showPrompt(editor);
+}
+
+void continuePrompt(int key, Editor* editor){
+  Prompt* prompt = &(editor->prompt);
+  if(key == NEWLINE){
+    prompt->isActive = false;
+    appendCharacter('\0', &(prompt->text));
+    --prompt->text.size;
+    prompt->answer(editor);
+  }else if(key == CANCEL_COMMAND){
+    prompt->isActive = false;
+    setMessage("(quit)", &(editor->window.statusPane)); //ad-hoc for demo
   }else{
-    add((char)key, row, editor->cursor.column);
+    if(key == DELETE_LEFT){
+      if(0 < prompt->text.size)
+        --prompt->text.size;
+    }else if(isText(key)){
+      appendCharacter((char)key, &(prompt->text));
+    }
+    showPrompt(editor);
+  }
+}
 
-    moveCursorRight(editor);
+void addHit(int row, int column, Hits* hits){
+  if(hits->count == hits->capacity){
+    hits->capacity = (hits->capacity == 0) ? 16 : hits->capacity * 2; //ad-hoc
+    hits->raw = realloc(hits->raw, sizeof(Point) * hits->capacity);
   }
+  hits->raw[hits->count].row = row;
+  hits->raw[hits->count].column = column;
+  ++hits->count;
 }
 
-void append(Row* one, Row* to){
-  while((to->size + one->size) > to->capacity){
-    extend(to);
+//leftmost longest matches which do not overlap each other, and return whether the row has only an empty one
+//(empty matches, as of "x*" or "^", are taken only on a row without the others, once at the first of them)
+bool scanRow(int at, Regex* regex, Buffer* buffer, Hits* hits){
+  View view = peekRow(at, buffer);
+  if(!hasMatch(regex, &view))
+    return false;
+  int size = view.frontSize + view.backSize;
+  int empty = -1; //(the first empty match)
+  int count = hits->count;
+  int c = 0;
+  while(c <= size){
+    int end = matchAt(regex, &view, c);
+    if(end == -1 || end == c){
+      if(end == c && empty == -1)
+        empty = c;
+      ++c;
+    }else{
+      addHit(at, c, hits);
+      c = end;
+    }
   }
-  for(int i = 0; i < one->size; i++){
-    to->raw[to->size] = one->raw[i];
-    ++to->size;
+  if(hits->count == count && empty != -1){
+    addHit(at, empty, hits);
+    return true;
   }
+  return false;
 }
 
-void deleteLeftCharacter(Editor* editor){
-  int r = editor->cursor.row;
-  int c = editor->cursor.column;
-  Row* row = editor->buffer.rows[r];
-  if(c == 0){
-    if(r != 0){
-      Row* previous = editor->buffer.rows[r - 1];
-      int pin = previous->size;
-      append(row, previous);
-      removeRow(r, &(editor->buffer));
+enum{SCAN_BATCH = 4096}; //ad-hoc (rows)
+
+void* scanBatches(void* argument){
+  Scan* scan = argument;
+  Buffer* buffer = scan->buffer;
+  int batch;
+  while(!__atomic_load_n(&(scan->isCancelled), __ATOMIC_RELAXED)
+      && (batch = __atomic_fetch_add(&(scan->nextBatch), 1, __ATOMIC_RELAXED)) < scan->batches){
+    int begin = batch * SCAN_BATCH;
+    int end = (buffer->size - begin < SCAN_BATCH) ? buffer->size : begin + SCAN_BATCH;
+    Hits* hits = &(scan->results[batch]);
+    int empty = 0;
+    for(int r = begin; r < end; r++){
+      if(scanRow(r, &(scan->regex), buffer, hits))
+        ++empty;
+    }
+    __atomic_fetch_add(&(scan->scannedRows), end - begin, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(scan->found), hits->count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(scan->empty), empty, __ATOMIC_RELAXED);
+  }
+  __atomic_fetch_add(&(scan->finished), 1, __ATOMIC_RELEASE);
+  return NULL;
+}
 
-      //"previouse" became the last row and is empty
-      if(r - 1 == editor->buffer.size - 1 && previous->size == 0)
-        previous->isEnabled = false;
+void beginScan(char* pattern, Editor* editor){
+  Scan* scan = &(editor->scan);
+  char* error;
+  if(!compileRegex(pattern, &(scan->regex), &error)){
+    Builder message;
+    initBuilder(64, &message); //ad-hoc
+    appendLiteral("(invalid regexp: ", &message);
+    appendString(error, &message);
+    appendLiteral(")", &message);
+    appendCharacter('\0', &message);
+    setMessage(message.raw, &(editor->window.statusPane));
+    free(message.raw);
+    return;
+  }
 
-      //move cursor to the pinned location
-      --editor->cursor.row;
-      editor->cursor.column = pin;
+  scan->pattern.size = 0;
+  appendString(pattern, &(scan->pattern));
+  scan->hits.count = 0;
+  scan->buffer = &(editor->buffer);
+  scan->batches = (editor->buffer.size + SCAN_BATCH - 1) / SCAN_BATCH;
+  scan->nextBatch = 0;
+  scan->scannedRows = 0;
+  scan->found = 0;
+  scan->empty = 0;
+  scan->finished = 0;
+  scan->isCancelled = false;
+  scan->results = calloc(scan->batches, sizeof(Hits));
+  scan->workers = countProcessors();
+  if(scan->batches < scan->workers)
+    scan->workers = scan->batches;
+  scan->threads = malloc(sizeof(pthread_t) * scan->workers);
+  for(int i = 0; i < scan->workers; i++){
+    if(pthread_create(&(scan->threads[i]), NULL, scanBatches, scan) != 0){ //the rest is left to the others
+      scan->workers = i;
+      break;
+    }
+  }
+  if(scan->workers == 0) //no thread at all
+    scanBatches(scan);
+  scan->isRunning = true;
+}
 
-      setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
+void answerFindAll(Editor* editor){
+  beginScan(editor->prompt.text.raw, editor);
+}
+
+void endScan(Editor* editor){
+  Scan* scan = &(editor->scan);
+  for(int i = 0; i < scan->workers; i++)
+    pthread_join(scan->threads[i], NULL);
+  free(scan->threads);
+
+  //the batches are in order of rows
+  Hits* hits = &(scan->hits);
+  hits->count = 0;
+  for(int i = 0; i < scan->batches; i++){
+    Hits* result = &(scan->results[i]);
+    if(hits->capacity < hits->count + result->count){
+      hits->capacity = hits->count + result->count;
+      hits->raw = realloc(hits->raw, sizeof(Point) * hits->capacity);
+    }
+    if(0 < result->count)
+      memcpy(hits->raw + hits->count, result->raw, sizeof(Point) * result->count);
+    hits->count += result->count;
+    free(result->raw);
+  }
+  free(scan->results);
+  freeRegex(&(scan->regex));
+  scan->isRunning = false;
+}
+
+void stopScan(Editor* editor){
+  Scan* scan = &(editor->scan);
+  if(scan->isRunning){
+    __atomic_store_n(&(scan->isCancelled), true, __ATOMIC_RELAXED);
+    endScan(editor);
+    scan->hits.count = 0;
+  }
+}
+
+//show how far the scan has gone, and end it once all the workers are done
+void watchScan(Editor* editor){
+  Scan* scan = &(editor->scan);
+  if(!scan->isRunning)
+    return;
+
+  bool isDone = (__atomic_load_n(&(scan->finished), __ATOMIC_ACQUIRE) == scan->workers);
+  if(isDone)
+    endScan(editor);
+
+  Builder message;
+  initBuilder(64, &message); //ad-hoc
+  appendLiteral("Regexp /", &message);
+  appendBytes(scan->pattern.raw, scan->pattern.size, &message);
+  appendLiteral("/: ", &message);
+  if(isDone){
+    appendNumber(scan->hits.count, &message);
+    appendLiteral(" matches", &message);
+    if(0 < scan->empty){
+      appendLiteral(" (", &message);
+      appendNumber(scan->empty, &message);
+      appendLiteral(" empty)", &message);
+    }
+  }else{
+    appendNumber(__atomic_load_n(&(scan->found), __ATOMIC_RELAXED), &message);
+    appendLiteral(" matches so far (", &message);
+    appendNumber((int)(100.0 * __atomic_load_n(&(scan->scannedRows), __ATOMIC_RELAXED) / editor->buffer.size), &message);
+    appendLiteral("%)", &message);
+  }
+  appendCharacter('\0', &message);
+  setMessage(message.raw, &(editor->window.statusPane));
+  free(message.raw);
+}
+
+bool isBefore(Point a, Point b){
+  return a.row < b.row || (a.row == b.row && a.column < b.column);
+}
+
+//(the worker's) append an entry to the text of the journal
+void serializeEntry(Entry* entry, Builder* builder){
+  char line[64];
+  if(entry->change == INSERTION)
+    snprintf(line, sizeof(line), "+ %d %d %zu\n", entry->from.row, entry->from.column, entry->length);
+  else
+    snprintf(line, sizeof(line), "- %d %d %d %d\n", entry->from.row, entry->from.column, entry->to.row, entry->to.column);
+  appendString(line, builder);
+}
+
+//(the worker's) open the journal to append to, beginning it with the file it is on if it is new
+int openJournal(Journal* journal, Builder* pending){
+  int fd = open(journal->path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+  struct stat status;
+  if(fd != -1 && fstat(fd, &status) == 0 && status.st_size == 0){
+    char line[64];
+    snprintf(line, sizeof(line), "journal %lld %lld\n", journal->size, journal->modified);
+    appendString(line, pending);
+  }
+  return fd;
+}
+
+//the worker: every "interval" ms, write the entries put since the last time and fsync them at once
+void* writeJournal(void* argument){
+  Journal* journal = (Journal*)argument;
+  int fd = -1;
+  Builder pending;
+  initBuilder(4096, &pending); //ad-hoc
+  struct pollfd wake = {journal->wake[0], POLLIN, 0};
+  while(true){
+    poll(&wake, 1, journal->interval);
+    if(__atomic_load_n(&(journal->isStopping), __ATOMIC_ACQUIRE))
+      break; //(the journal is removed, so the rest does not matter)
+
+    Entry* next;
+    while((next = __atomic_load_n(&(journal->head->next), __ATOMIC_ACQUIRE)) != NULL){
+      free(journal->head);
+      journal->head = next;
+      if(next->isSave){
+        //the file has all the edits so far, and the journal begins again on it
+        pending.size = 0;
+        if(fd != -1){
+          close(fd);
+          fd = -1;
+        }
+        unlink(journal->path);
+        journal->size = next->size;
+        journal->modified = next->modified;
+        continue;
+      }
+      if(fd == -1)
+        fd = openJournal(journal, &pending);
+      if(fd == -1)
+        continue; //ad-hoc: the edit is lost (no room, no permission, etc.)
+      serializeEntry(next, &pending);
+      if(next->change == INSERTION){
+        if(next->length < (size_t)JOURNAL_CHUNK){
+          appendBytes(next->text, (int)next->length, &pending);
+        }else{ //(a large text goes straight to the file)
+          flush(fd, &pending);
+          struct iovec vector = {next->text, next->length};
+          writeVectors(fd, &vector, 1);
+        }
+        appendCharacter('\n', &pending);
+      }
+      if(JOURNAL_CHUNK <= pending.size)
+        flush(fd, &pending);
+    }
+    if(fd != -1 && 0 < pending.size){
+      flush(fd, &pending);
+      fsync(fd);
+    }
+    pending.size = 0;
+  }
+  if(fd != -1)
+    close(fd);
+  free(pending.raw);
+  return NULL;
+}
+
+//whether a point is on the text of the buffer
+bool isOnText(Point point, Buffer* buffer){
+  return 0 <= point.row && point.row < buffer->size && 0 <= point.column && point.column <= measureRow(point.row, buffer);
+}
+
+//replay the edits in the journal on the buffer as an edit to be undone at once, and return how many they are
+//(-1: the journal is not on the file as it is now, -2: replayed, but what follows the last complete entry cannot be cut off)
+int replayJournal(Editor* editor){
+  Journal* journal = &(editor->journal);
+  Buffer* buffer = &(editor->buffer);
+  FILE* file = fopen(journal->path, "rb");
+  if(file == NULL)
+    return 0;
+  long long size;
+  long long modified;
+  if(fscanf(file, "journal %lld %lld", &size, &modified) != 2 || fgetc(file) != '\n'
+      || size != journal->size || modified != journal->modified){
+    fclose(file);
+    return -1;
+  }
+
+  //up to the last complete entry (the rest may have been cut by the crash)
+  long kept = ftell(file); //(offset right after the last complete entry)
+  int count = 0;
+  bool isChained = false;
+  char change;
+  while(fscanf(file, "%c", &change) == 1){
+    Point from;
+    Point to;
+    if(change == '+'){
+      size_t length;
+      if(fscanf(file, " %d %d %zu", &(from.row), &(from.column), &length) != 3 || fgetc(file) != '\n' || !isOnText(from, buffer))
+        break;
+      char* text = malloc(length + 1);
+      if(text == NULL || fread(text, 1, length, file) != length || fgetc(file) != '\n'){
+        free(text);
+        break;
+      }
+      editor->cursor.row = from.row;
+      editor->cursor.column = from.column;
+      restoreText(text, length, editor);
+      isChained = recordInsertion(from, here(editor), false, isChained, editor) || isChained;
+      free(text);
+    }else if(change == '-'){
+      if(fscanf(file, " %d %d %d %d", &(from.row), &(from.column), &(to.row), &(to.column)) != 4 || fgetc(file) != '\n'
+          || !isOnText(from, buffer) || !isOnText(to, buffer) || isBefore(to, from))
+        break;
+      isChained = recordDeletion(from, to, false, isChained, editor) || isChained;
+      deleteText(from, to, editor);
+    }else{
+      break;
     }
+    ++count;
+    kept = ftell(file);
+  }
+  fclose(file);
+  settleLastRow(buffer);
+  setLineNumberOffsetBy(buffer->size, &(editor->window.lineNumnerPane));
+  //what follows is cut off, as the entries of this session are appended to the journal
+  if(kept == -1 || truncate(journal->path, kept) == -1)
+    return -2;
+  return count;
+}
+
+//replay the journal left by a crash if any, and start the worker to keep the journal of the file ("interval": ms, 0: no journal)
+void startJournal(int interval, Editor* editor){
+  Journal* journal = &(editor->journal);
+  Source* source = &(editor->buffer.source);
+  StatusPane* statusPane = &(editor->window.statusPane);
+  if(source->path == NULL || interval <= 0)
+    return;
+
+  //".name.journal" beside "name"
+  const char* slash = strrchr(source->path, '/');
+  int directory = (slash == NULL) ? 0 : slash - source->path + 1;
+  size_t length = strlen(source->path);
+  journal->path = malloc(length + sizeof("..journal.stale"));
+  memcpy(journal->path, source->path, directory);
+  journal->path[directory] = '.';
+  memcpy(journal->path + directory + 1, source->path + directory, length - directory);
+  memcpy(journal->path + length + 1, ".journal", sizeof(".journal"));
+
+  struct stat status;
+  if(stat(source->path, &status) == 0){
+    journal->size = status.st_size;
+    journal->modified = status.st_mtime;
+  }else{
+    journal->size = -1;
+    journal->modified = -1;
+  }
+
+  int count = replayJournal(editor);
+  if(count == -1){ //(the file has been changed since, so the journal is put aside rather than lost)
+    char* stale = malloc(length + sizeof("..journal.stale"));
+    sprintf(stale, "%s.stale", journal->path);
+    rename(journal->path, stale);
+    free(stale);
+    setMessage("(the journal does not match the file, put aside as .stale)", statusPane); //ad-hoc for demo
+  }else if(count == -2){ //(the entries of this session would follow a broken one, where a replay stops)
+    setMessage("(recovered from the journal, which cannot be cut, so no journal)", statusPane); //ad-hoc for demo
+    free(journal->path);
+    journal->path = NULL;
+    return;
+  }else if(0 < count){
+    char message[64];
+    snprintf(message, sizeof(message), "(recovered %d edits from the journal)", count);
+    setMessage(message, statusPane); //ad-hoc for demo
+  }
+
+  journal->interval = interval;
+  journal->head = createEntry(0); //(an entry taken already)
+  journal->tail = journal->head;
+  journal->isStopping = false;
+  if(pipe(journal->wake) != 0){
+    free(journal->head);
+    free(journal->path);
+    journal->path = NULL;
+    return;
+  }
+  if(pthread_create(&(journal->worker), NULL, writeJournal, journal) != 0){
+    close(journal->wake[0]);
+    close(journal->wake[1]);
+    free(journal->head);
+    free(journal->path);
+    journal->path = NULL;
+    return;
+  }
+  journal->isEnabled = true;
+}
+
+//stop the worker and remove the journal, as the edits are either saved or thrown away by quitting
+void stopJournal(Editor* editor){
+  Journal* journal = &(editor->journal);
+  if(!journal->isEnabled)
+    return;
+  __atomic_store_n(&(journal->isStopping), true, __ATOMIC_RELEASE);
+  char wake = 0;
+  if(write(journal->wake[1], &wake, 1) == -1) //(even so, the worker wakes up in "interval" ms)
+    setMessage(strerror(errno), &(editor->window.statusPane));
+  pthread_join(journal->worker, NULL);
+  close(journal->wake[0]);
+  close(journal->wake[1]);
+  while(journal->head != NULL){
+    Entry* next = journal->head->next;
+    free(journal->head);
+    journal->head = next;
+  }
+  unlink(journal->path);
+  free(journal->path);
+  journal->path = NULL;
+  journal->isEnabled = false;
+}
+
+//move the cursor to the next (or previous) hit of the last scan
+void moveCursorToHit(bool isNext, Editor* editor){
+  Hits* hits = &(editor->scan.hits);
+  Point cursor = here(editor);
+  //the first hit after the cursor
+  int low = 0;
+  int high = hits->count;
+  while(low < high){
+    int middle = low + (high - low) / 2;
+    if(isBefore(cursor, hits->raw[middle]))
+      high = middle;
+    else
+      low = middle + 1;
+  }
+  int i = low;
+  if(!isNext){
+    //the last hit before the cursor
+    i = low - 1;
+    while(0 <= i && !isBefore(hits->raw[i], cursor))
+      --i;
+  }
+
+  if(0 <= i && i < hits->count){
+    editor->cursor.row = hits->raw[i].row;
+    editor->cursor.column = hits->raw[i].column;
+    Builder message;
+    initBuilder(32, &message); //ad-hoc
+    appendLiteral("(hit ", &message);
+    appendNumber(i + 1, &message);
+    appendCharacter('/', &message);
+    appendNumber(hits->count, &message);
+    appendLiteral(")", &message);
+    appendCharacter('\0', &message);
+    setMessage(message.raw, &(editor->window.statusPane));
+    free(message.raw);
   }else{
-    for(int i = c - 1; i < row->size; i++)
-      row->raw[i] = row->raw[i + 1];
-    --row->size;
+    setMessage("(no more hits)", &(editor->window.statusPane)); //ad-hoc for demo
+  }
+}
+
+void addRebuilt(int at, int count, Row* row, Rebuilds* rebuilds){
+  if(rebuilds->count == rebuilds->capacity){
+    rebuilds->capacity = (rebuilds->capacity == 0) ? 16 : rebuilds->capacity * 2; //ad-hoc
+    rebuilds->raw = realloc(rebuilds->raw, sizeof(Rebuilt) * rebuilds->capacity);
+  }
+  rebuilds->raw[rebuilds->count].at = at;
+  rebuilds->raw[rebuilds->count].count = count;
+  rebuilds->raw[rebuilds->count].row = row;
+  ++rebuilds->count;
+}
+
+//a new row of the "at"-th row in which every "from" is replaced in one pass (NULL: it has no "from")
+//(flat: for a row split by its gap, found: where each "from" begins)
+//(the row is stamped when it is swapped in, since stamp() is not for workers)
+Row* rebuildRow(int at, Replace* replace, Builder* flat, Hits* found){
+  View view = peekRow(at, replace->buffer);
+  char* text = view.front;
+  int length = view.frontSize + view.backSize;
+  if(0 < view.backSize){
+    flat->size = 0;
+    appendBytes(view.front, view.frontSize, flat);
+    appendBytes(view.back, view.backSize, flat);
+    text = flat->raw;
+  }
+
+  char* from = replace->from.raw;
+  int size = replace->from.size;
+  found->count = 0;
+  int c = 0;
+  while(c + size <= length){
+    int f = replace->finder->find(text + c, length - c, from, size);
+    if(f == -1)
+      break;
+    addHit(at, c + f, found);
+    c += f + size;
+  }
+  if(found->count == 0)
+    return NULL;
+
+  Builder* to = &(replace->to);
+  int rebuilt = length + found->count * (to->size - size);
+  Row* row = allocateRow(rebuilt <= ROW_SMALL, &(replace->buffer->arena));
+  provide(rebuilt, row);
+  row->size = rebuilt;
+  row->gap = rebuilt;
+  row->isEnabled = true;
+  row->isMapped = false;
+  row->measured = 0;
+  row->breakCount = 0;
+  row->breakCapacity = 0;
+  row->breaks = NULL;
+  char* destination = row->raw;
+  c = 0;
+  for(int i = 0; i < found->count; i++){
+    int begin = found->raw[i].column;
+    memcpy(destination, text + c, begin - c);
+    destination += begin - c;
+    memcpy(destination, to->raw, to->size);
+    destination += to->size;
+    c = begin + size;
+  }
+  memcpy(destination, text + c, length - c);
+  return row;
+}
+
+void* replaceBatches(void* argument){
+  Replace* replace = argument;
+  Buffer* buffer = replace->buffer;
+  Builder flat;
+  initBuilder(256, &flat); //ad-hoc
+  Hits found = {0, 0, NULL};
+  int batch;
+  while((batch = __atomic_fetch_add(&(replace->nextBatch), 1, __ATOMIC_RELAXED)) < replace->batches){
+    int begin = batch * SCAN_BATCH;
+    int end = (buffer->size - begin < SCAN_BATCH) ? buffer->size : begin + SCAN_BATCH;
+    Rebuilds* rebuilds = &(replace->results[batch]);
+    for(int r = begin; r < end; r++){
+      Row* row = rebuildRow(r, replace, &flat, &found);
+      if(row != NULL)
+        addRebuilt(r, found.count, row, rebuilds);
+    }
+  }
+  free(flat.raw);
+  free(found.raw);
+  return NULL;
+}
+
+double measureSeconds(struct timespec* from){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - from->tv_sec) + (now.tv_nsec - from->tv_nsec) / 1e9;
+}
+
+//(exact below HISTOGRAM_STEPS, and then HISTOGRAM_STEPS buckets for each power of 2)
+int bucketOf(unsigned long nanoseconds){
+  if(nanoseconds < HISTOGRAM_STEPS)
+    return (int)nanoseconds;
+  int exponent = 63 - __builtin_clzl(nanoseconds); //(HISTOGRAM_BITS or more)
+  return HISTOGRAM_STEPS * (exponent - HISTOGRAM_BITS + 1) + (int)((nanoseconds >> (exponent - HISTOGRAM_BITS)) & (HISTOGRAM_STEPS - 1));
+}
+
+//the smallest value in the bucket (the bucket after it begins with the largest one plus 1)
+unsigned long lowestOf(int bucket){
+  if(bucket < HISTOGRAM_STEPS)
+    return bucket;
+  int exponent = bucket / HISTOGRAM_STEPS + HISTOGRAM_BITS - 1;
+  return (unsigned long)(HISTOGRAM_STEPS + bucket % HISTOGRAM_STEPS) << (exponent - HISTOGRAM_BITS);
+}
 
-    moveCursorLeft(editor);
-  }
+void addSample(unsigned long nanoseconds, Histogram* histogram){
+  __atomic_fetch_add(&(histogram->buckets[bucketOf(nanoseconds)]), 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&(histogram->count), 1, __ATOMIC_RELAXED);
+  unsigned long longest = __atomic_load_n(&(histogram->longest), __ATOMIC_RELAXED);
+  while(longest < nanoseconds && !__atomic_compare_exchange_n(&(histogram->longest), &longest, nanoseconds, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
 }
 
-void deleteRightCharacter(Editor* editor){
-  int r = editor->cursor.row;
-  int c = editor->cursor.column;
-  Row* row = editor->buffer.rows[r];
-  if(c == row->size){
-    if(r != editor->buffer.size - 1){
-      Row* next = editor->buffer.rows[r + 1];
-      append(next, row);
-      removeRow(r + 1, &(editor->buffer));
+void addSampleSince(struct timespec* from, Histogram* histogram){
+  addSample((unsigned long)(measureSeconds(from) * 1e9), histogram);
+}
 
-      setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
+//the largest value of the bucket where the "fraction" of the samples is reached (at most the longest one)
+unsigned long percentileOf(double fraction, Histogram* histogram){
+  unsigned long count = __atomic_load_n(&(histogram->count), __ATOMIC_RELAXED);
+  unsigned long longest = __atomic_load_n(&(histogram->longest), __ATOMIC_RELAXED);
+  unsigned long rank = (unsigned long)(fraction * count + 0.999999); //ad-hoc (rounded up)
+  unsigned long seen = 0;
+  for(int i = 0; i < HISTOGRAM_BUCKETS - 1; i++){
+    seen += __atomic_load_n(&(histogram->buckets[i]), __ATOMIC_RELAXED);
+    if(rank <= seen && 0 < seen){
+      unsigned long largest = lowestOf(i + 1) - 1;
+      return (largest < longest) ? largest : longest;
     }
-  }else{
-    for(int i = c; i < row->size - 1; i++)
-      row->raw[i] = row->raw[i + 1];
-    --row->size;
   }
-  //"row" is the last row and is empty
-  if(r == editor->buffer.size - 1 && row->size == 0)
-    row->isEnabled = false;
+  return longest;
 }
 
-void deleteRightHalf(Editor* editor){
-  int r = editor->cursor.row;
-  int c = editor->cursor.column;
-  Row* row = editor->buffer.rows[r];
-  if(c == row->size){
-    if(r != editor->buffer.size - 1){
-      Row* next = editor->buffer.rows[r + 1];
-      append(next, row);
-      removeRow(r + 1, &(editor->buffer));
+void appendPercentiles(char* name, Histogram* histogram, Builder* builder){
+  appendString(name, builder);
+  appendCharacter(' ', builder);
+  appendNumber((int)(percentileOf(0.5, histogram) / 1000), builder);
+  appendCharacter('/', builder);
+  appendNumber((int)(percentileOf(0.99, histogram) / 1000), builder);
+  appendCharacter('/', builder);
+  appendNumber((int)(histogram->longest / 1000), builder);
+}
 
-      setLineNumberOffsetBy(editor->buffer.size, &(editor->window.lineNumnerPane));
-    }
-  }else{
-    row->size = c;
+void showLatency(Editor* editor){
+  Latency* latency = &(editor->latency);
+  Builder message;
+  initBuilder(128, &message); //ad-hoc
+  appendLiteral("us p50/p99/max: ", &message);
+  appendPercentiles("paint", &(latency->paint), &message);
+  appendPercentiles(", update", &(latency->update), &message);
+  appendPercentiles(", draw", &(latency->draw), &message);
+  appendPercentiles(", write", &(latency->write), &message);
+  appendLiteral(" (", &message);
+  appendNumber((int)latency->update.count, &message);
+  appendLiteral(" keys)", &message);
+  appendCharacter('\0', &message);
+  setMessage(message.raw, &(editor->window.statusPane));
+  free(message.raw);
+}
+
+void dumpHistogram(char* name, Histogram* histogram, FILE* file){
+  fprintf(file, "%s count %lu p50 %lu p99 %lu max %lu\n", name, histogram->count,
+    percentileOf(0.5, histogram), percentileOf(0.99, histogram), histogram->longest);
+  for(int i = 0; i < HISTOGRAM_BUCKETS; i++){
+    if(0 < histogram->buckets[i])
+      fprintf(file, "%s %lu %lu\n", name, lowestOf(i), histogram->buckets[i]);
   }
-  //"row" is the last row and is empty
-  if(r == editor->buffer.size - 1 && row->size == 0)
-    row->isEnabled = false;
 }
 
-void copyRegion(Editor* editor){
+//a summary line of each histogram ("name count n p50 ns p99 ns max ns"),
+//followed by its buckets which have any ("name lowest-ns count")
+bool dumpLatency(char* path, Editor* editor){
+  FILE* file = fopen(path, "w");
+  if(file == NULL){
+    perror(path);
+    return false;
+  }
+  Latency* latency = &(editor->latency);
+  dumpHistogram("paint", &(latency->paint), file);
+  dumpHistogram("update", &(latency->update), file);
+  dumpHistogram("draw", &(latency->draw), file);
+  dumpHistogram("write", &(latency->write), file);
+  if(fclose(file) == EOF){
+    perror(path);
+    return false;
+  }
+  return true;
+}
+
+//replace every "from" in the buffer with "to": the affected rows are rebuilt by workers and then swapped in
+//(the swap is recorded as a deletion and an insertion of each of those rows, chained into a single undo)
+void replaceAll(Editor* editor){
+  struct timespec began;
+  clock_gettime(CLOCK_MONOTONIC, &began);
+  Replace* replace = &(editor->replace);
   Buffer* buffer = &(editor->buffer);
-  Region* region = &(buffer->region);
-  Clipboard* clipboard = &(editor->clipboard);
-  if(region->isActive){
-    clearClipboard(clipboard);
+  replace->finder = chooseFinder(); //(chosen here, not by the workers)
+  replace->buffer = buffer;
+  replace->batches = (buffer->size + SCAN_BATCH - 1) / SCAN_BATCH;
+  replace->nextBatch = 0;
+  replace->results = calloc(replace->batches, sizeof(Rebuilds));
+
+  int workers = (1 < replace->batches) ? countProcessors() : 0; //(a small buffer is rebuilt right here)
+  if(replace->batches < workers)
+    workers = replace->batches;
+  pthread_t* threads = malloc(sizeof(pthread_t) * (workers + 1));
+  for(int i = 0; i < workers; i++){
+    if(pthread_create(&(threads[i]), NULL, replaceBatches, replace) != 0){ //the rest is left to the others
+      workers = i;
+      break;
+    }
+  }
+  if(workers == 0)
+    replaceBatches(replace);
+  for(int i = 0; i < workers; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
 
-    Clip* current = clipboard->head;
-    Point* head = region->head;
-    Point* tail = region->tail;
-    for(int r = head->row; r <= tail->row; r++){
-      Row* original = buffer->rows[r];
-      int start;
-      int end;
-      if(r == head->row){
-        start = head->column;
-        if(r == tail->row)
-          end = tail->column;
-        else
-          end = original->size;
-      }else if(r == tail->row){
-        start = 0;
-        end = tail->column;
-      }else{
-        start = 0;
-        end = original->size;
-      }
-      Row* copy = createEmptyRow(original->capacity);
-      int i = 0;
-      for(int c = start; c < end; c++){
-        copy->raw[i] = original->raw[c];
-        ++copy->size;
-        ++i;
-      }
-      Clip* clip = malloc(sizeof(Clip));
-      clip->row = copy;
-      clip->next = NULL;
-      if(current == NULL)
-        clipboard->head = clip;
-      else
-        current->next = clip;
-      current = clip;
+  if(buffer->region.isActive)
+    deactivateRegion(editor);
+  int count = 0;
+  bool isChained = false;
+  for(int b = 0; b < replace->batches; b++){
+    Rebuilds* rebuilds = &(replace->results[b]);
+    for(int i = 0; i < rebuilds->count; i++){
+      Rebuilt* rebuilt = &(rebuilds->raw[i]);
+      Point from = {rebuilt->at, 0};
+      Point to = {rebuilt->at, measureRow(rebuilt->at, buffer)};
+      recordDeletion(from, to, false, isChained, editor);
+      isChained = true;
+      releaseRow(rebuilt->at, buffer);
+      touch(rebuilt->row);
+      setRow(rebuilt->row, rebuilt->at, buffer);
+      indexRow(rebuilt->at, buffer);
+      to.column = rebuilt->row->size;
+      recordInsertion(from, to, false, true, editor);
+      if(editor->cursor.row == rebuilt->at && rebuilt->row->size < editor->cursor.column)
+        editor->cursor.column = rebuilt->row->size;
+      count += rebuilt->count;
     }
+    free(rebuilds->raw);
+  }
+  free(replace->results);
+  if(0 < count){
+    settleLastRow(buffer);
+    editor->scan.hits.count = 0; //(they would be out of date)
   }
+
+  Builder message;
+  initBuilder(64, &message); //ad-hoc
+  appendLiteral("Replaced ", &message);
+  appendNumber(count, &message);
+  appendLiteral(" occurrences in ", &message);
+  appendNumber((int)(measureSeconds(&began) * 1000), &message);
+  appendLiteral(" ms", &message);
+  appendCharacter('\0', &message);
+  setMessage(message.raw, &(editor->window.statusPane));
+  free(message.raw);
 }
 
-void deleteRegion(Editor* editor){
-  Buffer* buffer = &(editor->buffer);
-  Region* region = &(buffer->region);
-  Cursor* cursor = &(editor->cursor);
+void answerReplaceTo(Editor* editor){
+  Replace* replace = &(editor->replace);
+  replace->to.size = 0;
+  appendBytes(editor->prompt.text.raw, editor->prompt.text.size, &(replace->to));
+  replaceAll(editor);
+}
 
-  if(region->isActive){
-    Point* head = region->head;
-    Point* tail = region->tail;
-    if(head->row == tail->row){
-      if(head->column != tail->column){
-        Row* row = buffer->rows[head->row];
-        int start = head->column;
-        int end = tail->column;
-        int n = row->size - end;
-        for(int i = 0; i < n; i++)
-          row->raw[start + i] = row->raw[end + i];
-        row->size -= (end - start);
-      }
-    }else{
-      Row* first = buffer->rows[head->row];
-      Row* last = buffer->rows[tail->row];
-      Row* row = createEmptyRow(first->capacity + last->capacity);
-      for(int i = 0; i < head->column; i++){
-        row->raw[i] = first->raw[i];
-        ++row->size;
-      }
-      for(int i = tail->column; i < last->size; i++){
-        row->raw[row->size] = last->raw[i];
-        ++row->size;
-      }
-      row->isEnabled = true;
+void answerReplaceFrom(Editor* editor){
+  Replace* replace = &(editor->replace);
+  if(editor->prompt.text.size == 0){
+    setMessage("(nothing to replace)", &(editor->window.statusPane)); //ad-hoc for demo
+    return;
+  }
+  replace->from.size = 0;
+  appendBytes(editor->prompt.text.raw, editor->prompt.text.size, &(replace->from));
+  replace->label.size = 0;
+  appendLiteral("Replace all ", &(replace->label));
+  appendBytes(replace->from.raw, replace->from.size, &(replace->label));
+  appendLiteral(" with: ", &(replace->label));
+  appendCharacter('\0', &(replace->label));
+  beginPrompt(replace->label.raw, answerReplaceTo, editor);
+}
 
-      for(int i = head->row; i <= tail->row; i++){
-        Row* r = buffer->rows[i];
-        free(r->raw);
-        free(r);
-      }
-      buffer->rows[head->row] = row;
+void jumpTo(Point point, Editor* editor){
+  editor->cursor.row = point.row;
+  editor->cursor.column = point.column;
+  if(editor->buffer.region.isActive)
+    pointRegion(editor);
+  recenterCursor(editor);
+}
 
-      int m = buffer->size - (tail->row + 1);
-      for(int i = 0; i < m; i++)
-        buffer->rows[(head->row + 1) + i] = buffer->rows[(tail->row + 1) + i];
-      buffer->size -= (tail->row - head->row);
-    }
-    //move cursor to the begining of the region
-    cursor->row = head->row;
-    cursor->column = head->column;
+void answerGotoLine(Editor* editor){
+  char* text = editor->prompt.text.raw;
+  char* end;
+  long line = strtol(text, &end, 10);
+  if(end == text || *end != '\0' || line < 1){
+    setMessage("(not a line number)", &(editor->window.statusPane)); //ad-hoc for demo
+    return;
   }
+  Point point = {(line < editor->buffer.size) ? (int)line - 1 : editor->buffer.size - 1, 0};
+  jumpTo(point, editor);
+  setMessage("(goto line)", &(editor->window.statusPane)); //ad-hoc for demo
 }
 
-void pasteFromClipboard(Editor* editor){
-  Clipboard* clipboard = &(editor->clipboard);
-  if(clipboard->head != NULL){
-    int c = editor->cursor.column;
-    int r = editor->cursor.row;
-    Row* second = partition(editor->buffer.rows[r], c);
-
-    Clip* clip = clipboard->head;
-    while(clip != NULL){
-      Row* row = clip->row;
-      for(int i = 0; i < row->size; i++)
-        insert(row->raw[i], editor);
-
-      if(clip->next == NULL){
-        r = editor->cursor.row;
-        Row* current = editor->buffer.rows[r];
-        append(second, current);
-        free(second->raw);
-        free(second);
-      }else{
-        insert(NEWLINE, editor);
-      }
+//(offset: from 0, as parsers and compilers report)
+void answerGotoByte(Editor* editor){
+  char* text = editor->prompt.text.raw;
+  char* end;
+  unsigned long long offset = strtoull(text, &end, 10);
+  if(end == text || *end != '\0' || !isdigit((unsigned char)text[0])){
+    setMessage("(not a byte offset)", &(editor->window.statusPane)); //ad-hoc for demo
+    return;
+  }
+  jumpTo(pointAt((size_t)offset, &(editor->buffer)), editor);
+  setMessage("(goto byte)", &(editor->window.statusPane)); //ad-hoc for demo
+}
 
-      clip = clip->next;
-    }
+//whether the key changes the buffer
+bool isEditing(int key){
+  switch(key){
+    case DELETE_LEFT:
+    case DELETE_RIGHT:
+    case DELETE_RIGHT_HALF:
+    case NEWLINE:
+    case CUT_REGION:
+    case PASTE:
+    case PASTE_TEXT:
+    case YANK_POP:
+    case UNDO:
+    case REDO:
+      return true;
+    default:
+      return key < DELETE_LEFT || (DELETE_LEFT < key && key < DELETE_RIGHT); //(bytes to be inserted)
   }
 }
 
 /*
 //for debug
 void dumpClipboard(Clipboard* clipboard){
-  Clip* current = clipboard->head;
+  Clip* current = clipboard->kills[clipboard->latest].head;
   while(current != NULL){
-    Row* row = current->row;
-    for(int c = 0; c < row->size; c++){
-      fprintf(stderr, "%c", row->raw[c]);
-    }
-    fprintf(stderr, "\r\n");
+    View* view = &(current->view);
+    fprintf(stderr, "%.*s%.*s\r\n", view->frontSize, view->front, view->backSize, view->back);
     current = current->next;
   }
 }
@@ -809,17 +5214,42 @@ void update(Editor* editor, int key){
   Region* region = &(editor->buffer.region);
   StatusPane* statusPane = &(editor->window.statusPane);
 
+  if(editor->prompt.isActive && key != QUIT){
+    continuePrompt(key, editor);
+    scroll(editor);
+    return;
+  }
+  if(editor->search.isActive && continueSearch(key, editor)){
+    scroll(editor);
+    return;
+  }
+  if(isEditing(key)){
+    if(editor->scan.isRunning){
+      setMessage("(busy: regexp search is running, Ctrl-g to stop it)", statusPane); //ad-hoc for demo
+      return;
+    }
+    editor->scan.hits.count = 0; //(they would be out of date)
+  }
+
   switch(key){
     case QUIT:
+      stopScan(editor);
+      stopJournal(editor);
       editor->state = DONE;
       break;
 
+    case SAVE:
+      saveFile(editor);
+      break;
+
     case DELETE_LEFT:
       if(region->isActive){
+        recordDeletion(*(region->head), *(region->tail), false, false, editor);
         deleteRegion(editor);
         deactivateRegion(editor);
         setMessage("(delete region)", statusPane); //ad-hoc for demo
       }else{
+        recordDeletion(leftOf(editor), here(editor), true, false, editor);
         deleteLeftCharacter(editor);
         setMessage("(delete left)", statusPane); //ad-hoc for demo
       }
@@ -827,10 +5257,12 @@ void update(Editor* editor, int key){
 
     case DELETE_RIGHT:
       if(region->isActive){
+        recordDeletion(*(region->head), *(region->tail), false, false, editor);
         deleteRegion(editor);
         deactivateRegion(editor);
         setMessage("(delete region)", statusPane); //ad-hoc for demo
       }else{
+        recordDeletion(here(editor), rightOf(false, editor), true, false, editor);
         deleteRightCharacter(editor);
         setMessage("(delete right)", statusPane); //ad-hoc for demo
       }
@@ -881,6 +5313,7 @@ void update(Editor* editor, int key){
     case DELETE_RIGHT_HALF:
       if(region->isActive)
         deactivateRegion(editor);
+      recordDeletion(here(editor), rightOf(true, editor), false, false, editor);
       deleteRightHalf(editor);
       setMessage("(delete right half)", statusPane); //ad-hoc for demo
       break;
@@ -901,13 +5334,49 @@ void update(Editor* editor, int key){
 
     case RECENTER:
       recenterCursor(editor);
+      invalidate(&(editor->window));
       setMessage("(recenter)", statusPane); //ad-hoc for demo
       break;
 
     case CANCEL_COMMAND:
       if(region->isActive)
         deactivateRegion(editor);
-      setMessage("(cancel)", statusPane); //ad-hoc for demo
+      if(editor->scan.isRunning){
+        stopScan(editor);
+        setMessage("(regexp search stopped)", statusPane); //ad-hoc for demo
+      }else{
+        setMessage("(cancel)", statusPane); //ad-hoc for demo
+      }
+      break;
+
+    case FIND_ALL:
+      if(editor->scan.isRunning)
+        setMessage("(busy: regexp search is running, Ctrl-g to stop it)", statusPane); //ad-hoc for demo
+      else
+        beginPrompt("Find all (regexp): ", answerFindAll, editor);
+      break;
+
+    case NEXT_HIT:
+    case PREVIOUS_HIT:
+      if(editor->scan.isRunning)
+        setMessage("(busy: regexp search is running, Ctrl-g to stop it)", statusPane); //ad-hoc for demo
+      else
+        moveCursorToHit(key == NEXT_HIT, editor);
+      break;
+
+    case REPLACE_ALL:
+      if(editor->scan.isRunning)
+        setMessage("(busy: regexp search is running, Ctrl-g to stop it)", statusPane); //ad-hoc for demo
+      else
+        beginPrompt("Replace all: ", answerReplaceFrom, editor);
+      break;
+
+    case GOTO_LINE:
+      beginPrompt("Goto line: ", answerGotoLine, editor);
+      break;
+
+    case GOTO_BYTE:
+      beginPrompt("Goto byte: ", answerGotoByte, editor);
       break;
 
     case ACTIVATE_REGION:
@@ -927,6 +5396,7 @@ void update(Editor* editor, int key){
     case CUT_REGION:
       if(region->isActive){
         copyRegion(editor);
+        recordDeletion(*(region->head), *(region->tail), false, false, editor);
         deleteRegion(editor);
         deactivateRegion(editor);
       }
@@ -934,149 +5404,640 @@ void update(Editor* editor, int key){
       break;
 
     case PASTE:
-      if(region->isActive){
-        deleteRegion(editor);
-        deactivateRegion(editor);
+      {
+        bool isChained = false;
+        if(region->isActive){
+          isChained = recordDeletion(*(region->head), *(region->tail), false, false, editor);
+          deleteRegion(editor);
+          deactivateRegion(editor);
+        }
+        Point from = here(editor);
+        pasteFromClipboard(editor);
+        recordInsertion(from, here(editor), false, isChained, editor);
+      }
+      setMessage("(paste)", statusPane); //ad-hoc for demo
+      break;
+
+    case PASTE_TEXT:
+      {
+        bool isChained = false;
+        if(region->isActive){
+          isChained = recordDeletion(*(region->head), *(region->tail), false, false, editor);
+          deleteRegion(editor);
+          deactivateRegion(editor);
+        }
+        Point from = here(editor);
+        insertText(editor->input.paste.raw, editor->input.paste.size, editor);
+        recordInsertion(from, here(editor), false, isChained, editor);
       }
-      pasteFromClipboard(editor);
       setMessage("(paste)", statusPane); //ad-hoc for demo
       break;
 
+    case YANK_POP:
+      if(editor->clipboard.yank != -1){
+        Clipboard* clipboard = &(editor->clipboard);
+        bool isChained = recordDeletion(clipboard->yankFrom, clipboard->yankTo, false, false, editor);
+        pastePreviousKill(editor);
+        recordInsertion(clipboard->yankFrom, clipboard->yankTo, false, isChained, editor);
+        setMessage("(paste previous)", statusPane); //ad-hoc for demo
+      }else{
+        setMessage("(previous command was not a paste)", statusPane); //ad-hoc for demo
+      }
+      break;
+
+    case SEARCH_FORWARD:
+    case SEARCH_BACKWARD:
+      beginSearch(key == SEARCH_BACKWARD, editor);
+      break;
+
+    case UNDO:
+      if(undo(editor))
+        setMessage("(undo)", statusPane); //ad-hoc for demo
+      else
+        setMessage("(no further undo)", statusPane); //ad-hoc for demo
+      break;
+
+    case REDO:
+      if(redo(editor))
+        setMessage("(redo)", statusPane); //ad-hoc for demo
+      else
+        setMessage("(no further redo)", statusPane); //ad-hoc for demo
+      break;
+
+    case SHOW_LATENCY:
+      showLatency(editor);
+      break;
+
     default:
-      if(region->isActive){
-        deleteRegion(editor);
-        deactivateRegion(editor);
+      {
+        bool isChained = false;
+        if(region->isActive){
+          isChained = recordDeletion(*(region->head), *(region->tail), false, false, editor);
+          deleteRegion(editor);
+          deactivateRegion(editor);
+        }
+        Point from = here(editor);
+        insert(key, editor);
+        recordInsertion(from, here(editor), key != NEWLINE, isChained, editor);
       }
-      insert(key, editor);
       setMessage("(insert)", statusPane); //ad-hoc for demo
       break;
   }
+  if(key != PASTE && key != YANK_POP)
+    editor->clipboard.yank = -1;
   scroll(editor);
 }
 
-void draw(Editor* editor){
-  int horizontalOffset = editor->window.lineNumnerPane.offset;
-  int verticalOffset = editor->window.statusPane.rows;
-  char* format = editor->window.lineNumnerPane.format;
+bool isSameAppearance(Appearance* a, Appearance* b){
+  return a->row == b->row
+      && a->stamp == b->stamp
+      && a->number == b->number
+      && a->isEnabled == b->isEnabled
+      && a->isCurrent == b->isCurrent
+      && a->from == b->from
+      && a->to == b->to
+      && a->scroll == b->scroll
+      && a->offset == b->offset
+      && a->state == b->state;
+}
+
+void look(Editor* editor, int r, Appearance* appearance){
   Region* region = &(editor->buffer.region);
-             //ToDo: use snprintf()
-             //ToDo: window needs to hold frame capacity
-  int f = 0; //ToDo: expand frame when needed
-  char* frame = editor->window.frame;
-
-  f += sprintf(frame + f, "\x1b[?25l"); //hide cursor
-  f += sprintf(frame + f, "\x1b[H"); //move cursor to home (top-left)
-
-  bool doneRenderingRegion = !(region->isActive);
-
-  for(int wr = 0; wr < editor->window.rows - verticalOffset; wr++){
-    int r = wr + editor->window.scroll.row;
-    if(r < editor->buffer.size){
-      Row* row = editor->buffer.rows[r];
-      if(row->isEnabled){
-        bool isCurrentRow;
-        if(r == editor->cursor.row)
-          isCurrentRow = true;
-        else
-          isCurrentRow = false;
-
-        //line number pane
-        f += sprintf(frame + f, "\x1b[90m"); //90:bright black (foreground)
-        f += sprintf(frame + f, format, r + 1);
-        f += sprintf(frame + f, "\x1b[0m"); //0: reset
-
-        //highlight current line
-        if(isCurrentRow)
-          f += sprintf(frame + f, "\x1b[48;5;18m"); //48:(background), 5:(indexed color), 18:(color code)
-
-        bool isRenderingRegion = false;
-        for(int wc = 0; wc < editor->window.columns - horizontalOffset; wc++){
-          int c = wc + editor->window.scroll.column;
-
-          if(!doneRenderingRegion){
-            if(!isRenderingRegion){
-              if((r == region->head->row && c == region->head->column) || (region->head->row < r && r <= region->tail->row)){
-                isRenderingRegion = true;
-                f += sprintf(frame + f, "\x1b[48;5;66m"); //48:(background), 5:(indexed color), 66:(color code)
-              }
+  appearance->row = NULL;
+  appearance->stamp = 0;
+  appearance->number = r + 1;
+  appearance->isEnabled = false;
+  appearance->isCurrent = (r == editor->cursor.row);
+  appearance->from = -2;
+  appearance->to = -2;
+  appearance->scroll = editor->window.scroll.column;
+  appearance->offset = editor->window.lineNumnerPane.offset;
+  appearance->state = 0;
+  if(r < editor->buffer.size){
+    if(editor->buffer.syntax != NULL)
+      appearance->state = stateAt(r, &(editor->buffer));
+    Row* row = getRow(r, &(editor->buffer));
+    appearance->row = row;
+    appearance->stamp = row->stamp;
+    appearance->isEnabled = row->isEnabled;
+    Search* search = &(editor->search);
+    if(search->isActive && search->isFound && 0 < search->query.size && r == search->match.row){ //the match looks like a region
+      appearance->from = search->match.column;
+      appearance->to = search->match.column + search->query.size;
+    }else if(region->isActive && region->head->row <= r && r <= region->tail->row){
+      appearance->from = (r == region->head->row) ? region->head->column : -1;
+      appearance->to = (r == region->tail->row) ? region->tail->column : INT_MAX;
+    }
+  }
+}
+
+//SGR parameters of the foreground colors of the tokens (in the order of Token)
+char* tokenColors[] = {
+  "39", //PLAIN: (default)
+  "38;5;75", //KEYWORD: (indexed color) blue
+  "38;5;114", //TYPE: green
+  "38;5;173", //NUMBER: orange
+  "38;5;180", //STRING: tan
+  "38;5;244", //COMMENT: gray
+  "38;5;170" //DIRECTIVE: magenta
+};
+
+void drawRow(Editor* editor, Appearance* appearance, Builder* line){
+  int horizontalOffset = appearance->offset;
+
+  Row* row = appearance->row;
+  if(row != NULL){
+    if(row->isEnabled){
+      bool isCurrentRow = appearance->isCurrent;
+
+      //line number pane
+      appendLiteral("\x1b[90m", line); //90:bright black (foreground)
+      appendPaddedNumber(appearance->number, horizontalOffset, line);
+      appendLiteral("\x1b[0m", line); //0: reset
+
+      //highlight current line
+      if(isCurrentRow)
+        appendLiteral("\x1b[48;5;18m", line); //48:(background), 5:(indexed color), 18:(color code)
+
+      bool doneRenderingRegion = (appearance->from == -2);
+      bool isRenderingRegion = false;
+      int columns = editor->window.columns - horizontalOffset;
+      int tabWidth = editor->window.tabWidth;
+      int c = byteAt(appearance->scroll, row, tabWidth); //(from, to and c are bytes, while wc is a display column)
+      int wc = columnAt(c, row, tabWidth) - appearance->scroll; //(negative: a wide character or a tab cut by the left edge)
+
+      //tokens of the row from its lexer state, while only the states are kept
+      Syntax* syntax = editor->buffer.syntax;
+      char* tokens = NULL;
+      Token color = PLAIN; //(foreground so far, which "\x1b[0m" resets to PLAIN)
+      if(syntax != NULL){
+        Builder* scratch = &(editor->window.tokens);
+        scratch->size = 0;
+        reserve(row->size, scratch);
+        tokens = scratch->raw;
+        View view = viewSlot(row, &(editor->buffer));
+        syntax->lex(&view, appearance->state, tokens);
+      }
+      while(true){
+        if(!doneRenderingRegion){
+          if(!isRenderingRegion){
+            if(appearance->from <= c){ //(including -1)
+              isRenderingRegion = true;
+              appendLiteral("\x1b[48;5;66m", line); //48:(background), 5:(indexed color), 66:(color code)
             }
-            if(isRenderingRegion){
-              if(r == region->tail->row && c == region->tail->column){
-                if(isCurrentRow)
-                  f += sprintf(frame + f, "\x1b[48;5;18m"); //48:(background), 5:(indexed color), 18:(color code)
-                else
-                  f += sprintf(frame + f, "\x1b[0m"); //0:reset
-                isRenderingRegion = false;
-                doneRenderingRegion = true;
-              }
+          }
+          if(isRenderingRegion){
+            if(appearance->to <= c){
+              if(isCurrentRow)
+                appendLiteral("\x1b[48;5;18m", line); //48:(background), 5:(indexed color), 18:(color code)
+              else
+                appendLiteral("\x1b[0m", line); //0:reset
+              color = PLAIN;
+              isRenderingRegion = false;
+              doneRenderingRegion = true;
             }
           }
+        }
 
-          if(c < row->size){
-            if(row->raw[c] == '\t' || iscntrl(row->raw[c])){
-              char dummy;
-              if(row->raw[c] == '\t')
-                dummy = ' '; //ToDo:ad-hoc, 1 space for now
-              else //ToDo:ad-hoc, non-printable (<= 31)
-                dummy = '?';
-
-              f += sprintf(frame + f, "\x1b[4m"); //4:underline
-              f += sprintf(frame + f, "%c", dummy);
-              f += sprintf(frame + f, "\x1b[0m"); //0:reset
+        if(row->size <= c){
+          appendLiteral("\x1b[0K", line); //clear rest of line
+          break;
+        }else if(columns <= wc){
+          break;
+        }
 
-              if(isCurrentRow)
-                f += sprintf(frame + f, "\x1b[48;5;18m"); //highlight current line
-            }else{
-              frame[f] = row->raw[c];
-              ++f;
-            }
-          }else{
-            f += sprintf(frame + f, "\x1b[0K"); //clear rest of line
-            break;
+        int codepoint;
+        int length = decodeCharacter(c, row, &codepoint);
+        int width = (codepoint == '\t') ? tabWidth - (appearance->scroll + wc) % tabWidth : measureCharacter(codepoint);
+        if(wc < 0 || columns < wc + width || codepoint == '\t'){ //a tab, or a wide character which does not fit in the screen
+          for(int i = (wc < 0 ? 0 : wc); i < wc + width && i < columns; i++)
+            appendCharacter(' ', line);
+        }else if(!isShown(codepoint)){ //ToDo:ad-hoc, non-printable (<= 31) or invalid
+          appendLiteral("\x1b[4m", line); //4:underline
+          appendCharacter('?', line);
+          appendLiteral("\x1b[0m", line); //0:reset
+          color = PLAIN;
+
+          if(isCurrentRow)
+            appendLiteral("\x1b[48;5;18m", line); //highlight current line
+          if(isRenderingRegion)
+            appendLiteral("\x1b[48;5;66m", line); //(back in the region)
+        }else{
+          if(tokens != NULL && (Token)tokens[c] != color){
+            color = (Token)tokens[c];
+            appendLiteral("\x1b[", line);
+            appendString(tokenColors[color], line);
+            appendCharacter('m', line);
           }
+          for(int i = 0; i < length; i++)
+            appendCharacter(getCharacter(c + i, row), line);
         }
-        isRenderingRegion = false;
-        f += sprintf(frame + f, "\x1b[0m"); //end highlight current line
-      }else{ //row is not enabled. Either the buffer is empty or the very last line of the buffer has not been enabled yet.
-        for(int i = 0; i < editor->window.lineNumnerPane.offset; i++) //ad-hoc
-          f += sprintf(frame + f, " "); //for line number part
-        f += sprintf(frame + f, "\x1b[0K"); //clear rest of line
+        c += length;
+        wc += width;
       }
-    }else{
-      f += sprintf(frame + f, "\x1b[2K"); //clear line
+      appendLiteral("\x1b[0m", line); //end highlight current line
+    }else{ //row is not enabled. Either the buffer is empty or the very last line of the buffer has not been enabled yet.
+      for(int i = 0; i < horizontalOffset; i++) //ad-hoc
+        appendCharacter(' ', line); //for line number part
+      appendLiteral("\x1b[0K", line); //clear rest of line
     }
-    f += sprintf(frame + f, "\r\n");
+  }else{
+    appendLiteral("\x1b[2K", line); //clear line
   }
+}
 
-  //statu pane
-  f += sprintf(frame + f, "\x1b[30;47m"); //30: black (foreground), 47:bright black (background)
-  int offset = sprintf(frame + f, "(%d,%d) ", editor->cursor.row + 1, editor->cursor.column);
-  f += offset;
+void drawStatus(Editor* editor, Builder* line){
+  appendLiteral("\x1b[30;47m", line); //30: black (foreground), 47:bright black (background)
+  int start = line->size;
+  appendCharacter('(', line);
+  appendNumber(editor->cursor.row + 1, line);
+  appendCharacter(',', line);
+  appendNumber(editor->cursor.column, line);
+  appendLiteral(") ", line);
+  //how far the cursor is through the text
+  Buffer* buffer = &(editor->buffer);
+  size_t total = countBytes(buffer);
+  appendNumber((0 < total) ? (int)(100.0 * offsetOf(here(editor), buffer) / total) : 0, line);
+  appendLiteral("% ", line);
+  int offset = line->size - start;
   for(int i = 0; i < editor->window.statusPane.columns - offset; i++)
-    f += sprintf(frame + f, "-");
-  f += sprintf(frame + f, "\x1b[0m"); //0: reset
-  f += sprintf(frame + f, "\r\n");
+    appendCharacter('-', line);
+  appendLiteral("\x1b[0m", line); //0: reset
+}
+
+void drawMessage(Editor* editor, Builder* line){
+  appendString(editor->window.statusPane.message, line);
+  appendLiteral("\x1b[K", line); //clear rest of line
+}
+
+//only the lines of the screen which look different from the last time are put in the frame
+void render(Editor* editor){
+  Window* window = &(editor->window);
+  int horizontalOffset = window->lineNumnerPane.offset;
+  int verticalOffset = window->statusPane.rows;
+  Builder* frame = &(window->frame);
+  bool isChanged = false;
+
+  frame->size = 0;
+  for(int wr = 0; wr < window->rows; wr++){
+    Line* line = &(window->lines[wr]);
+    Builder* scratch = &(window->scratch);
+    Appearance appearance;
+    scratch->size = 0;
+    if(wr < window->rows - verticalOffset){
+      look(editor, wr + window->scroll.row, &appearance);
+      if(line->isValid && isSameAppearance(&appearance, &(line->appearance)))
+        continue;
+      drawRow(editor, &appearance, scratch);
+    }else if(wr == window->rows - verticalOffset){
+      drawStatus(editor, scratch);
+    }else{
+      drawMessage(editor, scratch);
+    }
+
+    if(!line->isValid || line->text.size != scratch->size || memcmp(line->text.raw, scratch->raw, scratch->size) != 0){
+      if(!isChanged){
+        appendLiteral("\x1b[?25l", frame); //hide cursor
+        isChanged = true;
+      }
+      appendCursorPosition(wr + 1, 1, frame); //move cursor to the beginning of the line
+      appendBytes(scratch->raw, scratch->size, frame);
+
+      Builder drawn = *scratch;
+      *scratch = line->text;
+      line->text = drawn;
+    }
+    if(wr < window->rows - verticalOffset)
+      line->appearance = appearance;
+    line->isValid = true;
+  }
+
+  appendCursorPosition(editor->cursor.row - window->scroll.row + 1, getCursorColumn(editor) - window->scroll.column + 1 + horizontalOffset, frame); //move cursor
+  if(isChanged)
+    appendLiteral("\x1b[?25h", frame); //show cursor
+}
+
+//the frame is sent with a single write()
+void draw(Editor* editor){
+  render(editor);
+  if(editor->window.output != -1)
+    flush(editor->window.output, &(editor->window.frame));
+}
+
+//draw, with how long it takes to build the frame and to write it
+void paint(Editor* editor){
+  Latency* latency = &(editor->latency);
+  struct timespec began;
+  clock_gettime(CLOCK_MONOTONIC, &began);
+  render(editor);
+  addSampleSince(&began, &(latency->draw));
+  clock_gettime(CLOCK_MONOTONIC, &began);
+  flush(editor->window.output, &(editor->window.frame));
+  addSampleSince(&began, &(latency->write));
+}
+
+volatile sig_atomic_t isResized = 0; //(set by the handler of SIGWINCH, and taken by the main loop)
 
-  //message
-  f += sprintf(frame + f, "%s", editor->window.statusPane.message);
-  f += sprintf(frame + f, "\x1b[K"); //clear rest of line
-  //f += sprintf(frame + f, "\x1b[J"); //clear rest of screen
+void noteResize(int number){
+  isResized = (number == SIGWINCH);
+}
+
+//from SIGWINCH on, only the main loop gets it, while waiting for input (SIG_BLOCK before any thread starts, as they inherit the mask)
+void catchResize(){
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = noteResize;
+  sigemptyset(&(action.sa_mask));
+  sigaction(SIGWINCH, &action, NULL);
+  sigset_t resize;
+  sigemptyset(&resize);
+  sigaddset(&resize, SIGWINCH);
+  pthread_sigmask(SIG_BLOCK, &resize, NULL);
+}
 
-  f += sprintf(frame + f, "\x1b[%d;%dH", editor->cursor.row - editor->window.scroll.row + 1, editor->cursor.column - editor->window.scroll.column + 1 + horizontalOffset); //move cursor
-  f += sprintf(frame + f, "\x1b[?25h"); //show cursor
-  frame[f] = '\0';
+//take the new size of the terminal once SIGWINCHs stop coming for a while (a drag of the edge sends a lot of them)
+void followResize(Editor* editor){
+  do{
+    isResized = 0;
+  }while(!waitForInput(&(editor->input), RESIZE_SETTLING) && isResized); //(a key ends the wait, as it is to be drawn in the new size)
 
-  printf("%s", frame);
+  struct winsize ws;
+  if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1)
+    return;
+  int rows = (ws.ws_row < WINDOW_MIN_ROWS) ? WINDOW_MIN_ROWS : ws.ws_row;
+  int columns = (ws.ws_col < WINDOW_MIN_COLUMNS) ? WINDOW_MIN_COLUMNS : ws.ws_col;
+  if(rows == editor->window.rows && columns == editor->window.columns)
+    return;
+  Window* window = &(editor->window);
+  sizeWindow(rows, columns, window);
+  //no more scrolled to the right than the cursor needs (wider, the window may show the lines from their beginnings), and then the cursor back in sight
+  int needed = getCursorColumn(editor) + 1 - (window->columns - window->lineNumnerPane.offset);
+  if(needed < window->scroll.column)
+    window->scroll.column = (needed < 0) ? 0 : needed;
+  scroll(editor);
+  paint(editor);
 }
 
 void start(Editor* editor){
+  Latency* latency = &(editor->latency);
+  struct timespec typed; //(when the first key not drawn yet was read)
+  bool isTyped = false;
   editor->state = RUNNING;
   draw(editor);
 
   while(editor->state == RUNNING){
-    int key = readKey();
+    if(isResized){
+      followResize(editor);
+      continue;
+    }
+    //keep showing the progress of a scan until a key arrives
+    if(editor->scan.isRunning && !waitForInput(&(editor->input), 100)){ //ad-hoc (ms)
+      watchScan(editor);
+      paint(editor);
+      continue;
+    }
+    if(!waitForInput(&(editor->input), -1)) //(resized)
+      continue;
+    int key = readKey(&(editor->input));
+    struct timespec read;
+    clock_gettime(CLOCK_MONOTONIC, &read);
+    if(!isTyped){
+      typed = read;
+      isTyped = true;
+    }
+    update(editor, key);
+    watchScan(editor);
+    addSampleSince(&read, &(latency->update));
+    //skip drawing while the following keys have already arrived
+    if(!hasPendingInput(&(editor->input))){
+      paint(editor);
+      addSampleSince(&typed, &(latency->paint));
+      isTyped = false;
+    }
+  }
+}
+
+void addKey(int key, Script* script){
+  if(script->count == script->capacity){
+    script->capacity = (script->capacity < 64) ? 64 : script->capacity * 2; //ad-hoc
+    script->keys = realloc(script->keys, sizeof(int) * script->capacity);
+  }
+  script->keys[script->count++] = key;
+}
+
+void addPaste(const char* text, int length, Script* script){
+  addKey(PASTE_TEXT, script);
+  addKey(length, script);
+  appendBytes(text, length, &(script->texts));
+}
+
+//a key by its name in Key (-1: no such key)
+int findKey(const char* name){
+  static const struct{
+    char* name;
+    int key;
+  } keys[] = {
+    {"DELETE_LEFT", DELETE_LEFT}, {"DELETE_RIGHT", DELETE_RIGHT}, {"DELETE_RIGHT_HALF", DELETE_RIGHT_HALF},
+    {"NEWLINE", NEWLINE}, {"UP", UP}, {"DOWN", DOWN}, {"RIGHT", RIGHT}, {"LEFT", LEFT},
+    {"RIGHTMOST", RIGHTMOST}, {"LEFTMOST", LEFTMOST}, {"UPWARD", UPWARD}, {"DOWNWARD", DOWNWARD},
+    {"RECENTER", RECENTER}, {"ACTIVATE_REGION", ACTIVATE_REGION}, {"COPY_REGION", COPY_REGION},
+    {"CUT_REGION", CUT_REGION}, {"PASTE", PASTE}, {"CANCEL_COMMAND", CANCEL_COMMAND}, {"SAVE", SAVE},
+    {"YANK_POP", YANK_POP}, {"UNDO", UNDO}, {"REDO", REDO}, {"SEARCH_FORWARD", SEARCH_FORWARD},
+    {"SEARCH_BACKWARD", SEARCH_BACKWARD}, {"FIND_ALL", FIND_ALL}, {"NEXT_HIT", NEXT_HIT},
+    {"PREVIOUS_HIT", PREVIOUS_HIT}, {"REPLACE_ALL", REPLACE_ALL}, {"GOTO_LINE", GOTO_LINE},
+    {"GOTO_BYTE", GOTO_BYTE}, {"SHOW_LATENCY", SHOW_LATENCY}, {"QUIT", QUIT}
+  };
+  int n = sizeof(keys) / sizeof(keys[0]);
+  for(int i = 0; i < n; i++){
+    if(strcmp(keys[i].name, name) == 0)
+      return keys[i].key;
+  }
+  return -1;
+}
+
+//bytes as typed on a terminal, up to QUIT (or the end of them)
+void readRawScript(int fd, Script* script){
+  Input input;
+  input.fd = fd;
+  input.head = 0;
+  input.size = 0;
+  initBuilder(256, &(input.paste)); //ad-hoc
+  int key;
+  do{
+    key = readKey(&input);
+    if(key == PASTE_TEXT)
+      addPaste(input.paste.raw, input.paste.size, script);
+    else
+      addKey(key, script);
+  }while(key != QUIT);
+  free(input.paste.raw);
+}
+
+//a name of a key on each line, followed by how many times it is repeated if any ("DOWN 100"),
+//or TEXT and PASTE_TEXT followed by the text to be typed or pasted ("\n", "\t", "\r" and "\\" are escaped)
+//(empty lines and lines from "#" are skipped)
+bool readNamedScript(int fd, Script* script){
+  Builder text;
+  initBuilder(4096, &text); //ad-hoc
+  ssize_t n;
+  do{
+    reserve(4096, &text);
+    n = read(fd, text.raw + text.size, 4096);
+    if(0 < n)
+      text.size += n;
+  }while(0 < n || (n == -1 && errno == EINTR));
+  if(n == -1){
+    perror("readNamedScript()");
+    free(text.raw);
+    return false;
+  }
+
+  Builder line;
+  initBuilder(256, &line); //ad-hoc
+  Builder typed;
+  initBuilder(256, &typed); //ad-hoc
+  bool isValid = true;
+  int number = 0;
+  for(int at = 0; at < text.size && isValid; ){
+    ++number;
+    char* end = memchr(text.raw + at, '\n', text.size - at);
+    int length = (end == NULL) ? text.size - at : end - (text.raw + at);
+    line.size = 0;
+    appendBytes(text.raw + at, length, &line);
+    appendCharacter('\0', &line);
+    at += length + 1;
+    if(length == 0 || line.raw[0] == '#')
+      continue;
+
+    char* name = line.raw;
+    char* rest = name + strcspn(name, " ");
+    if(*rest == ' ')
+      *rest++ = '\0';
+    if(strcmp(name, "TEXT") == 0 || strcmp(name, "PASTE_TEXT") == 0){
+      typed.size = 0;
+      for(char* c = rest; *c != '\0'; c++){
+        if(*c == '\\' && c[1] != '\0'){
+          ++c;
+          appendCharacter((char)unescape(*c), &typed);
+        }else{
+          appendCharacter(*c, &typed);
+        }
+      }
+      if(name[0] == 'P'){
+        addPaste(typed.raw, typed.size, script);
+      }else{
+        for(int i = 0; i < typed.size; i++){
+          char c = typed.raw[i];
+          addKey((c == '\n' || c == '\r') ? NEWLINE : (unsigned char)c, script);
+        }
+      }
+      continue;
+    }
+
+    int key = findKey(name);
+    char* digits;
+    long times = (*rest == '\0') ? 1 : strtol(rest, &digits, 10);
+    if(key == -1 || times < 1 || INT_MAX < times || (*rest != '\0' && *digits != '\0')){
+      fprintf(stderr, "script line %d: no such key (or count) as \"%s\"\n", number, name);
+      isValid = false;
+    }else{
+      for(long i = 0; i < times; i++)
+        addKey(key, script);
+    }
+  }
+  addKey(QUIT, script);
+  free(typed.raw);
+  free(line.raw);
+  free(text.raw);
+  return isValid;
+}
+
+bool loadScript(char* path, bool isNamed, Script* script){
+  script->keys = NULL;
+  script->count = 0;
+  script->capacity = 0;
+  initBuilder(64, &(script->texts)); //ad-hoc
+  int fd = open(path, O_RDONLY);
+  if(fd == -1){
+    perror(path);
+    return false;
+  }
+  bool isLoaded = true;
+  if(isNamed)
+    isLoaded = readNamedScript(fd, script);
+  else
+    readRawScript(fd, script);
+  close(fd);
+  return isLoaded;
+}
+
+void freeScript(Script* script){
+  free(script->keys);
+  free(script->texts.raw);
+}
+
+void addTiming(struct timespec* from, Timing* timing, Histogram* histogram){
+  double seconds = measureSeconds(from);
+  timing->total += seconds;
+  if(timing->longest < seconds)
+    timing->longest = seconds;
+  ++timing->count;
+  addSample((unsigned long)(seconds * 1e9), histogram);
+}
+
+void reportTiming(char* name, Timing* timing){
+  fprintf(stderr, "%s_count %d\n", name, timing->count);
+  fprintf(stderr, "%s_total_ms %.3f\n", name, timing->total * 1e3);
+  fprintf(stderr, "%s_mean_us %.3f\n", name, (0 < timing->count) ? timing->total * 1e6 / timing->count : 0);
+  fprintf(stderr, "%s_max_us %.3f\n", name, timing->longest * 1e6);
+}
+
+void drawTimed(Timing* timing, long* drawn, Editor* editor){
+  struct timespec began;
+  clock_gettime(CLOCK_MONOTONIC, &began);
+  draw(editor);
+  addTiming(&began, timing, &(editor->latency.draw));
+  *drawn += editor->window.frame.size;
+}
+
+//the main loop without a terminal: the keys come from the script, and the frames are only built if drawn at all
+//(how long update() and draw() took goes to stderr)
+void runScript(Script* script, bool isDrawn, Editor* editor){
+  Timing updating = {0, 0, 0};
+  Timing drawing = {0, 0, 0};
+  long drawn = 0;
+  editor->state = RUNNING;
+  editor->window.output = -1;
+  if(isDrawn)
+    drawTimed(&drawing, &drawn, editor);
+
+  int pasted = 0;
+  for(int i = 0; i < script->count && editor->state == RUNNING; i++){
+    int key = script->keys[i];
+    if(key == PASTE_TEXT){
+      int length = script->keys[++i];
+      editor->input.paste.size = 0;
+      appendBytes(script->texts.raw + pasted, length, &(editor->input.paste));
+      pasted += length;
+    }
+    struct timespec began;
+    clock_gettime(CLOCK_MONOTONIC, &began);
     update(editor, key);
-    draw(editor);
+    //(a scan is waited for, as if the next key came after it)
+    while(editor->scan.isRunning){
+      watchScan(editor);
+      if(editor->scan.isRunning)
+        poll(NULL, 0, 1); //ad-hoc (ms)
+    }
+    addTiming(&began, &updating, &(editor->latency.update));
+    if(isDrawn)
+      drawTimed(&drawing, &drawn, editor);
+  }
+
+  reportTiming("update", &updating);
+  if(isDrawn){
+    reportTiming("draw", &drawing);
+    fprintf(stderr, "drawn_bytes %ld\n", drawn);
   }
 }
 
@@ -1110,20 +6071,89 @@ struct termios* createRawModeSettinsFrom(struct termios* terminalIOMode){
   return raw;
 }
 
-int main(){
+#ifndef EDITOR_NO_MAIN
+int main(int argc, char** argv){
+  size_t limit = KILL_RING_LIMIT;
+  size_t historyLimit = HISTORY_LIMIT;
+  int tabWidth = TAB_WIDTH;
+  int interval = JOURNAL_INTERVAL;
+  char* scriptPath = NULL;
+  bool isNamed = false;
+  bool isDrawn = false;
+  int rows = 24, columns = 80; //ad-hoc (default size of the virtual window)
+  char* latencyPath = NULL;
+  int option;
+  while((option = getopt(argc, argv, "k:u:t:j:s:S:g:dl:")) != -1){
+    if(option == 'k'){
+      limit = strtoull(optarg, NULL, 10);
+    }else if(option == 'u'){
+      historyLimit = strtoull(optarg, NULL, 10);
+    }else if(option == 't' && 0 < atoi(optarg) && atoi(optarg) <= UCHAR_MAX){
+      tabWidth = atoi(optarg);
+    }else if(option == 'j'){
+      interval = atoi(optarg);
+    }else if(option == 's' || option == 'S'){
+      scriptPath = optarg;
+      isNamed = (option == 'S');
+    }else if(option == 'g' && sscanf(optarg, "%dx%d", &rows, &columns) == 2 && WINDOW_MIN_ROWS <= rows && WINDOW_MIN_COLUMNS <= columns){
+      continue;
+    }else if(option == 'd'){
+      isDrawn = true;
+    }else if(option == 'l'){
+      latencyPath = optarg;
+    }else{
+      fprintf(stderr, "usage: %s [-k kill-ring-bytes] [-u undo-bytes] [-t tab-width] [-j journal-ms] [-s script | -S named-script] [-g rowsxcolumns] [-d] [-l latency-file] [file]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  //headless: the keys of a script are run, and then the buffer is dumped to stdout (without a journal)
+  if(scriptPath != NULL){
+    Script script;
+    if(!loadScript(scriptPath, isNamed, &script)){
+      freeScript(&script);
+      return 1;
+    }
+    Editor* editor = createSizedEditor(rows, columns);
+    editor->clipboard.limit = limit;
+    editor->history.limit = historyLimit;
+    editor->window.tabWidth = tabWidth;
+    if(optind < argc)
+      openFile(argv[optind], editor);
+    runScript(&script, isDrawn, editor);
+    writeRows(STDOUT_FILENO, &(editor->buffer));
+    if(latencyPath != NULL)
+      dumpLatency(latencyPath, editor);
+    dispose(editor);
+    freeScript(&script);
+    return 0;
+  }
+
   struct termios original;
   if(tcgetattr(STDIN_FILENO, &original) != -1){
     struct termios* raw = createRawModeSettinsFrom(&original);
     if(tcsetattr(STDIN_FILENO, TCSAFLUSH, raw) != -1){
       free(raw);
       resetScreen();
+      setBracketedPaste(true);
+      catchResize();
 
       Editor* editor = createEditor();
       if(editor != NULL){
+        editor->clipboard.limit = limit;
+        editor->history.limit = historyLimit;
+        editor->window.tabWidth = tabWidth;
+        if(optind < argc){
+          openFile(argv[optind], editor);
+          startJournal(interval, editor);
+        }
         start(editor);
+        if(latencyPath != NULL)
+          dumpLatency(latencyPath, editor);
         dispose(editor);
       }
 
+      setBracketedPaste(false);
       if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &original) == -1)
         perror("tcsetattr (original)");
       resetScreen();
@@ -1135,3 +6165,4 @@ int main(){
   }
   return 0;
 }
+#endif